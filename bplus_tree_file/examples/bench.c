@@ -0,0 +1,485 @@
+/********************************************************************************
+ *  bench.c                                                                     *
+ *  Το αρχείο αυτό μετράει την απόδοση του επιπέδου ΒΔ: εισαγωγές ανά          *
+ *  δευτερόλεπτο (σειριακές, τυχαίες, με πολλά διπλότυπα κλειδιά), χρόνο        *
+ *  αναζήτησης ενός κλειδιού (εκατοστημόρια) και εγγραφές ανά δευτερόλεπτο σε   *
+ *  σαρώσεις διαστήματος, για κάθε τύπο κλειδιού. Για κάθε μέτρηση τυπώνει και  *
+ *  τις κλήσεις BF_GetBlock, τα hits/misses του buffer pool και τα block που    *
+ *  διαβάστηκαν ή γράφτηκαν στο δίσκο ανά πράξη.                                *
+ *                                                                              *
+ *  Χρήση: ./build/bench [εγγραφές] [μέγεθος σελίδας] [block του buffer pool]   *
+ *         [κομμάτια των αντιγράφων block]                                      *
+ ********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "bf.h"
+#include "AM.h"
+
+#define LOOKUPS 10000
+#define LOOKUP_THREADS 4
+#define RANGE_SCANS 200
+#define RANGE_ROWS 1000
+
+/********************************************************************************
+ *  Μετρητές. Οι κλήσεις της BF_GetBlock από το AM.c περνούν από την             *
+ *  __wrap_BF_GetBlock (το Makefile συνδέει με -Wl,--wrap=BF_GetBlock), ενώ οι   *
+ *  read/write που κάνει το libbf περνούν από τις read/write αυτού του αρχείου.  *
+ *  Ένα BF_GetBlock που δεν διάβασε block από το δίσκο είναι hit.               *
+ ********************************************************************************/
+static long get_blocks = 0;
+static long block_reads = 0;
+static long block_writes = 0;
+
+BF_ErrorCode __real_BF_GetBlock(const int file_desc, const int block_num, BF_Block *block);
+
+BF_ErrorCode __wrap_BF_GetBlock(const int file_desc, const int block_num, BF_Block *block) {
+	get_blocks++;
+	return __real_BF_GetBlock(file_desc, block_num, block);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+	ssize_t bytes = syscall(SYS_read, fd, buf, count);
+	if (bytes > 0) {
+		block_reads += (bytes+BF_BLOCK_SIZE-1)/BF_BLOCK_SIZE;
+	}
+	return bytes;
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+	ssize_t bytes = syscall(SYS_write, fd, buf, count);
+	if (bytes > 0 && fd > 2) {
+		block_writes += (bytes+BF_BLOCK_SIZE-1)/BF_BLOCK_SIZE;
+	}
+	return bytes;
+}
+
+struct counters {
+	double seconds;
+	long get_blocks;
+	long block_reads;
+	long block_writes;
+};
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static void start(struct counters *c) {
+	c->seconds = now();
+	c->get_blocks = get_blocks;
+	c->block_reads = block_reads;
+	c->block_writes = block_writes;
+}
+
+static void stop(struct counters *c) {
+	c->seconds = now()-c->seconds;
+	c->get_blocks = get_blocks-c->get_blocks;
+	c->block_reads = block_reads-c->block_reads;
+	c->block_writes = block_writes-c->block_writes;
+}
+
+static void report(const char *key, const char *workload, long ops, const char *unit, const struct counters *c) {
+	long hits = c->get_blocks-c->block_reads;
+	if (hits < 0) {
+		hits = 0;
+	}
+	printf("%-6s %-12s %9ld %12.0f %-9s %8.2f %8.2f %8.2f %8.2f %6.1f%%\n",
+		key, workload, ops, ops/c->seconds, unit,
+		(double)c->get_blocks/ops, (double)hits/ops, (double)c->block_reads/ops, (double)c->block_writes/ops,
+		c->get_blocks > 0 ? 100.0*hits/c->get_blocks : 0.0);
+}
+
+/********************************************************************************
+ *  Κλειδιά. Το κλειδί number γράφεται στο key ανάλογα με τον τύπο του: ως int, *
+ *  ως float ή ως αριθμός με μηδενικά μπροστά για τα 'c', ώστε η σειρά των      *
+ *  συμβολοσειρών να είναι ίδια με τη σειρά των αριθμών.                        *
+ ********************************************************************************/
+static void makeKey(char attrType, int attrLength, int number, char *key) {
+	if (attrType == 'i') {
+		memcpy(key, &number, sizeof(int));
+	} else if (attrType == 'f') {
+		float value = (float)number;
+		memcpy(key, &value, sizeof(float));
+	} else {
+		char digits[32];
+		int width = attrLength-1 < 10 ? attrLength-1 : 10;
+		memset(key, 0, attrLength);
+		snprintf(digits, sizeof(digits), "%0*d", width, number);
+		memcpy(key, digits, width);
+	}
+}
+
+static int createIndex(const char *fileName, char attrType, int attrLength, int pageSize) {
+	remove(fileName);
+	if (AM_CreateIndexWithPageSize((char *) fileName, attrType, attrLength, 'i', sizeof(int), pageSize) != AME_OK) {
+		AM_PrintError("Error in AM_CreateIndexWithPageSize");
+		exit(1);
+	}
+	int fileDesc = AM_OpenIndex((char *) fileName);
+	if (fileDesc < 0 || fileDesc >= MAX_OPEN_FILES) {
+		AM_PrintError("Error in AM_OpenIndex");
+		exit(1);
+	}
+	return fileDesc;
+}
+
+static void closeIndex(const char *fileName, int fileDesc) {
+	if (AM_CloseIndex(fileDesc) != AME_OK) {
+		AM_PrintError("Error in AM_CloseIndex");
+	}
+	remove(fileName);
+}
+
+static void insertRows(int fileDesc, char attrType, int attrLength, const int *numbers, int rows) {
+	char key[256];
+	for (int i = 0; i < rows; i++) {
+		makeKey(attrType, attrLength, numbers[i], key);
+		if (AM_InsertEntry(fileDesc, key, &i) != AME_OK) {
+			AM_PrintError("Error in AM_InsertEntry");
+			exit(1);
+		}
+	}
+}
+
+static void printStats(const char *key, const char *workload, int fileDesc) {
+	AM_Stats stats;
+	if (AM_GetStats(fileDesc, &stats) != AME_OK) {
+		AM_PrintError("Error in AM_GetStats");
+		return;
+	}
+	long splits = 0;
+	for (int i = 0; i < AM_STATS_LEVELS; i++) {
+		splits += stats.splits[i];
+	}
+	printf("%-6s %-12s height %d, leaves %ld, fill %.1f%%, appends %ld, splits %ld (leaves %ld, root %ld), merges %ld, "
+		"pages freed %ld, reused %ld, free %ld, leaf jumps %ld, pins %ld, cached nodes %ld, cached blocks %ld, prefetched %ld, comparisons %ld, bytes copied %ld\n",
+		key, workload, stats.height, stats.leaves, 100.0*stats.leaf_fill, stats.appends, splits, stats.splits[0], stats.root_splits,
+		stats.merges, stats.freed_pages, stats.reused_pages, stats.free_pages, stats.leaf_jumps, stats.blocks_pinned, stats.cached_nodes,
+		stats.cached_blocks, stats.prefetched_pages, stats.comparisons, stats.bytes_copied);
+}
+
+/* Αναζητήσεις ενός νήματος, για τη μέτρηση με LOOKUP_THREADS νήματα στο ίδιο ευρετήριο */
+struct lookup_thread {
+	int fileDesc;
+	char attrType;
+	int attrLength;
+	int rows;
+	unsigned int seed;
+};
+
+static void *lookupThread(void *arg) {
+	struct lookup_thread *t = arg;
+	char key[256];
+	for (int i = 0; i < LOOKUPS/LOOKUP_THREADS; i++) {
+		makeKey(t->attrType, t->attrLength, rand_r(&t->seed)%t->rows, key);
+		int scanDesc = AM_OpenIndexScan(t->fileDesc, EQUAL, key);
+		if (scanDesc < 0 || scanDesc >= MAX_OPEN_SCANS || AM_FindNextEntry(scanDesc) == NULL) {
+			AM_PrintError("Error in lookup");
+			exit(1);
+		}
+		AM_CloseIndexScan(scanDesc);
+	}
+	return NULL;
+}
+
+static int compareDoubles(const void *first, const void *second) {
+	double a = *(const double *) first, b = *(const double *) second;
+	return (a > b) - (a < b);
+}
+
+static void bulkScan(const char *name, const char *fileName, char attrType, int attrLength, int rows, int pageSize) {
+	int entry = attrLength+sizeof(int);
+	char *entries = malloc((size_t) entry*rows);
+	for (int i = 0; i < rows; i++) {
+		makeKey(attrType, attrLength, i, entries+(size_t) entry*i);
+		memcpy(entries+(size_t) entry*i+attrLength, &i, sizeof(int));
+	}
+	int fileDesc = createIndex(fileName, attrType, attrLength, pageSize);
+	struct counters c;
+	start(&c);
+	if (AM_BulkLoad(fileDesc, entries, rows, 1.0) != AME_OK) {
+		AM_PrintError("Error in AM_BulkLoad");
+		exit(1);
+	}
+	stop(&c);
+	report(name, "bulk-load", rows, "rows/s", &c);
+	free(entries);
+
+	int *out = malloc(sizeof(int)*RANGE_ROWS);
+	char key[256];
+	long scanned = 0;
+	int nRows;
+	makeKey(attrType, attrLength, -1, key);
+	AM_ResetStats(fileDesc);
+	start(&c);
+	int scanDesc = AM_OpenIndexScan(fileDesc, NOT_EQUAL, key);
+	while (AM_FindNextBatch(scanDesc, out, RANGE_ROWS, &nRows) == AME_OK) {
+		scanned += nRows;
+	}
+	AM_CloseIndexScan(scanDesc);
+	stop(&c);
+	report(name, "scan-bulk", scanned, "rows/s", &c);
+	printStats(name, "scan-bulk", fileDesc);
+	free(out);
+
+	AM_Stats stats;
+	if (AM_GetStats(fileDesc, &stats) != AME_OK || (stats.leaves > 1 && stats.prefetched_pages == 0)) {
+		printf("%-6s %-12s the scan of %ld leaves asked for none of them ahead\n", name, "scan-bulk", stats.leaves);
+		exit(1);
+	}
+	closeIndex(fileName, fileDesc);
+}
+
+static void benchKey(const char *name, char attrType, int attrLength, int rows, int pageSize) {
+	const char *fileName = "BENCH";
+	int *numbers = malloc(sizeof(int)*rows);
+	struct counters c;
+	int fileDesc;
+
+	/* Σειριακές εισαγωγές */
+	for (int i = 0; i < rows; i++) {
+		numbers[i] = i;
+	}
+	fileDesc = createIndex(fileName, attrType, attrLength, pageSize);
+	start(&c);
+	insertRows(fileDesc, attrType, attrLength, numbers, rows);
+	stop(&c);
+	report(name, "insert-seq", rows, "ins/s", &c);
+	printStats(name, "insert-seq", fileDesc);
+	closeIndex(fileName, fileDesc);
+
+	/* Φόρτωση των ίδιων εγγραφών με την AM_BulkLoad, και σάρωση όλου του αρχείου. Τα φύλλα γράφονται το ένα μετά
+	 * το άλλο, οπότε η σάρωση πρέπει να ζητήσει τα επόμενα από το σύστημα πριν τα διαβάσει */
+	bulkScan(name, fileName, attrType, attrLength, rows, pageSize);
+
+	/* Εισαγωγές με πολλά διπλότυπα: κάθε κλειδί εμφανίζεται περίπου 100 φορές */
+	for (int i = 0; i < rows; i++) {
+		numbers[i] = rand()%(rows/100+1);
+	}
+	fileDesc = createIndex(fileName, attrType, attrLength, pageSize);
+	start(&c);
+	insertRows(fileDesc, attrType, attrLength, numbers, rows);
+	stop(&c);
+	report(name, "insert-dup", rows, "ins/s", &c);
+	printStats(name, "insert-dup", fileDesc);
+	closeIndex(fileName, fileDesc);
+
+	/* Τυχαίες εισαγωγές: μια τυχαία μετάθεση των 0..rows-1 */
+	for (int i = 0; i < rows; i++) {
+		numbers[i] = i;
+	}
+	for (int i = rows-1; i > 0; i--) {
+		int j = rand()%(i+1);
+		int temp = numbers[i];
+		numbers[i] = numbers[j];
+		numbers[j] = temp;
+	}
+	fileDesc = createIndex(fileName, attrType, attrLength, pageSize);
+	start(&c);
+	insertRows(fileDesc, attrType, attrLength, numbers, rows);
+	stop(&c);
+	report(name, "insert-rand", rows, "ins/s", &c);
+	printStats(name, "insert-rand", fileDesc);
+
+	/* Αναζητήσεις ενός κλειδιού που υπάρχει, με το χρόνο της καθεμιάς */
+	double *latencies = malloc(sizeof(double)*LOOKUPS);
+	char key[256];
+	start(&c);
+	for (int i = 0; i < LOOKUPS; i++) {
+		makeKey(attrType, attrLength, rand()%rows, key);
+		double begin = now();
+		int scanDesc = AM_OpenIndexScan(fileDesc, EQUAL, key);
+		if (scanDesc < 0 || scanDesc >= MAX_OPEN_SCANS || AM_FindNextEntry(scanDesc) == NULL) {
+			AM_PrintError("Error in lookup");
+			exit(1);
+		}
+		AM_CloseIndexScan(scanDesc);
+		latencies[i] = now()-begin;
+	}
+	stop(&c);
+	report(name, "lookup", LOOKUPS, "lookups/s", &c);
+	qsort(latencies, LOOKUPS, sizeof(double), compareDoubles);
+	printf("%-6s %-12s p50 %.2f us, p90 %.2f us, p99 %.2f us, max %.2f us\n", name, "lookup",
+		latencies[LOOKUPS/2]*1e6, latencies[LOOKUPS*9/10]*1e6, latencies[LOOKUPS*99/100]*1e6, latencies[LOOKUPS-1]*1e6);
+	free(latencies);
+
+	/* Οι ίδιες αναζητήσεις από LOOKUP_THREADS νήματα μαζί */
+	pthread_t threads[LOOKUP_THREADS];
+	struct lookup_thread lookups[LOOKUP_THREADS];
+	start(&c);
+	for (int i = 0; i < LOOKUP_THREADS; i++) {
+		lookups[i] = (struct lookup_thread) {fileDesc, attrType, attrLength, rows, (unsigned int) i+1};
+		pthread_create(&threads[i], NULL, lookupThread, &lookups[i]);
+	}
+	for (int i = 0; i < LOOKUP_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	stop(&c);
+	report(name, "lookup-4t", LOOKUPS/LOOKUP_THREADS*LOOKUP_THREADS, "lookups/s", &c);
+
+	/* Σαρώσεις διαστήματος: RANGE_ROWS εγγραφές από ένα τυχαίο κλειδί και πέρα */
+	int *out = malloc(sizeof(int)*RANGE_ROWS);
+	long scanned = 0;
+	AM_ResetStats(fileDesc);
+	start(&c);
+	for (int i = 0; i < RANGE_SCANS; i++) {
+		int nRows;
+		makeKey(attrType, attrLength, rand()%rows, key);
+		int scanDesc = AM_OpenIndexScan(fileDesc, GREATER_THAN_OR_EQUAL, key);
+		if (AM_FindNextBatch(scanDesc, out, RANGE_ROWS, &nRows) == AME_OK) {
+			scanned += nRows;
+		}
+		AM_CloseIndexScan(scanDesc);
+	}
+	stop(&c);
+	report(name, "scan-range", scanned, "rows/s", &c);
+	printStats(name, "scan-range", fileDesc);
+
+	/* Σάρωση όλου του αρχείου */
+	scanned = 0;
+	makeKey(attrType, attrLength, -1, key);
+	AM_ResetStats(fileDesc);
+	start(&c);
+	int scanDesc = AM_OpenIndexScan(fileDesc, NOT_EQUAL, key);
+	int nRows;
+	while (AM_FindNextBatch(scanDesc, out, RANGE_ROWS, &nRows) == AME_OK) {
+		scanned += nRows;
+	}
+	AM_CloseIndexScan(scanDesc);
+	stop(&c);
+	report(name, "scan-full", scanned, "rows/s", &c);
+	printStats(name, "scan-full", fileDesc);
+	free(out);
+
+	/* Διαγραφές των μισών εγγραφών των τυχαίων εισαγωγών */
+	AM_ResetStats(fileDesc);
+	start(&c);
+	for (int i = 0; i < rows; i += 2) {
+		makeKey(attrType, attrLength, numbers[i], key);
+		if (AM_DeleteEntry(fileDesc, key, &i) != AME_OK) {
+			AM_PrintError("Error in AM_DeleteEntry");
+			exit(1);
+		}
+	}
+	stop(&c);
+	report(name, "delete", (rows+1)/2, "dels/s", &c);
+	printStats(name, "delete", fileDesc);
+
+	/* Οι διαγραμμένες εγγραφές εισάγονται ξανά, στις σελίδες που ελευθερώθηκαν */
+	AM_ResetStats(fileDesc);
+	start(&c);
+	for (int i = 0; i < rows; i += 2) {
+		makeKey(attrType, attrLength, numbers[i], key);
+		if (AM_InsertEntry(fileDesc, key, &i) != AME_OK) {
+			AM_PrintError("Error in AM_InsertEntry");
+			exit(1);
+		}
+	}
+	stop(&c);
+	report(name, "reinsert", (rows+1)/2, "ins/s", &c);
+	printStats(name, "reinsert", fileDesc);
+
+	/* Συμπύκνωση μετά τις διασπάσεις, και ξανά σάρωση όλου του αρχείου */
+	AM_ResetStats(fileDesc);
+	start(&c);
+	if (AM_Compact(fileDesc, 1.0) != AME_OK) {
+		AM_PrintError("Error in AM_Compact");
+		exit(1);
+	}
+	stop(&c);
+	report(name, "compact", rows, "rows/s", &c);
+	printStats(name, "compact", fileDesc);
+
+	/* Τα φύλλα είναι πλέον το ένα μετά το άλλο στο αρχείο, οπότε η σάρωση ζητά τα επόμενα από το σύστημα */
+	out = malloc(sizeof(int)*RANGE_ROWS);
+	scanned = 0;
+	makeKey(attrType, attrLength, -1, key);
+	AM_ResetStats(fileDesc);
+	start(&c);
+	scanDesc = AM_OpenIndexScan(fileDesc, NOT_EQUAL, key);
+	while (AM_FindNextBatch(scanDesc, out, RANGE_ROWS, &nRows) == AME_OK) {
+		scanned += nRows;
+	}
+	AM_CloseIndexScan(scanDesc);
+	stop(&c);
+	report(name, "scan-compact", scanned, "rows/s", &c);
+	printStats(name, "scan-compact", fileDesc);
+
+	/* Το ίδιο αρχείο ανοίγει μόνο για ανάγνωση, με mmap, και επαναλαμβάνονται οι αναζητήσεις και η σάρωση */
+	if (AM_CloseIndex(fileDesc) != AME_OK) {
+		AM_PrintError("Error in AM_CloseIndex");
+		exit(1);
+	}
+	fileDesc = AM_OpenIndexReadOnly((char *) fileName);
+	if (fileDesc < 0 || fileDesc >= MAX_OPEN_FILES) {
+		AM_PrintError("Error in AM_OpenIndexReadOnly");
+		exit(1);
+	}
+	start(&c);
+	for (int i = 0; i < LOOKUPS; i++) {
+		makeKey(attrType, attrLength, rand()%rows, key);
+		scanDesc = AM_OpenIndexScan(fileDesc, EQUAL, key);
+		if (scanDesc < 0 || scanDesc >= MAX_OPEN_SCANS || AM_FindNextEntry(scanDesc) == NULL) {
+			AM_PrintError("Error in lookup");
+			exit(1);
+		}
+		AM_CloseIndexScan(scanDesc);
+	}
+	stop(&c);
+	report(name, "lookup-mmap", LOOKUPS, "lookups/s", &c);
+
+	scanned = 0;
+	makeKey(attrType, attrLength, -1, key);
+	AM_ResetStats(fileDesc);
+	start(&c);
+	scanDesc = AM_OpenIndexScan(fileDesc, NOT_EQUAL, key);
+	while (AM_FindNextBatch(scanDesc, out, RANGE_ROWS, &nRows) == AME_OK) {
+		scanned += nRows;
+	}
+	AM_CloseIndexScan(scanDesc);
+	stop(&c);
+	report(name, "scan-mmap", scanned, "rows/s", &c);
+	printStats(name, "scan-mmap", fileDesc);
+	free(out);
+
+	closeIndex(fileName, fileDesc);
+	free(numbers);
+}
+
+int main(int argc, char **argv) {
+	int rows = argc > 1 ? atoi(argv[1]) : 50000;
+	int pageSize = argc > 2 ? atoi(argv[2]) : BF_BLOCK_SIZE;
+	AM_Config config = {argc > 3 ? atoi(argv[3]) : BF_BUFFER_SIZE, 0, AM_REPLACE_LRU, 0, argc > 4 ? atoi(argv[4]) : 0};
+	if (rows < 100) {
+		rows = 100;
+	}
+
+	if (AM_InitWithConfig(&config) != AME_OK) {
+		AM_PrintError("Error in AM_InitWithConfig");
+		return 1;
+	}
+	srand(1);
+
+	printf("rows %d, page size %d, buffer pool %d blocks, cache shards %d\n", rows, pageSize, config.buffer_blocks,
+		config.cache_shards ? config.cache_shards : AM_CACHE_SHARDS);
+	printf("%-6s %-12s %9s %12s %-9s %8s %8s %8s %8s %7s\n",
+		"key", "workload", "ops", "rate", "", "get/op", "hit/op", "read/op", "write/op", "hit");
+
+	benchKey("i4", 'i', sizeof(int), rows, pageSize);
+	benchKey("f4", 'f', sizeof(float), rows, pageSize);
+	benchKey("c8", 'c', 8, rows, pageSize);
+	benchKey("c40", 'c', 40, rows, pageSize);
+	benchKey("c100", 'c', 100, rows, pageSize);
+
+	AM_Close();
+	return 0;
+}
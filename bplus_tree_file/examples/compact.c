@@ -0,0 +1,64 @@
+/********************************************************************************
+ *  compact.c                                                                   *
+ *  Το αρχείο αυτό συμπυκνώνει ένα υπάρχον αρχείο ΒΔ με την AM_Compact: τα      *
+ *  φύλλα του ξαναγράφονται το ένα μετά το άλλο με τη σειρά των κλειδιών τους,  *
+ *  ώστε μια σάρωση διαστήματος να διαβάζει το αρχείο σειριακά. Τυπώνει το      *
+ *  σχήμα του δέντρου και το μέγεθος του αρχείου πριν και μετά.                 *
+ *                                                                              *
+ *  Χρήση: ./build/compact <αρχείο> [ποσοστό πληρότητας, προεπιλογή 1.0]        *
+ ********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "AM.h"
+
+static void printShape(const char *when, const char *fileName, int fileDesc) {
+	AM_Stats stats;
+	struct stat st;
+	if (AM_GetStats(fileDesc, &stats) != AME_OK) {
+		AM_PrintError("Error in AM_GetStats");
+		exit(1);
+	}
+	if (stat(fileName, &st) != 0) {
+		st.st_size = 0;
+	}
+	printf("%-7s height %d, leaves %ld, entries %ld, fill %.1f%%, leaf jumps %ld, free pages %ld, file %ld bytes\n",
+		when, stats.height, stats.leaves, stats.entries, 100.0*stats.leaf_fill, stats.leaf_jumps, stats.free_pages,
+		(long) st.st_size);
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		printf("Usage: %s <file> [fill factor]\n", argv[0]);
+		return 1;
+	}
+	char *fileName = argv[1];
+	float fillFactor = argc > 2 ? atof(argv[2]) : 1.0;
+
+	AM_Init();
+
+	/* Ένα λάθος της AM_OpenIndex μπορεί να μοιάζει με θέση του Files_array, γι' αυτό ελέγχεται και το AM_errno */
+	AM_errno = AME_OK;
+	int fileDesc = AM_OpenIndex(fileName);
+	if (AM_errno != AME_OK || fileDesc < 0 || fileDesc >= MAX_OPEN_FILES) {
+		AM_PrintError("Error in AM_OpenIndex");
+		return 1;
+	}
+	printShape("before", fileName, fileDesc);
+
+	if (AM_Compact(fileDesc, fillFactor) != AME_OK) {
+		AM_PrintError("Error in AM_Compact");
+		AM_CloseIndex(fileDesc);
+		return 1;
+	}
+	printShape("after", fileName, fileDesc);
+
+	if (AM_CloseIndex(fileDesc) != AME_OK) {
+		AM_PrintError("Error in AM_CloseIndex");
+		return 1;
+	}
+	AM_Close();
+	return 0;
+}
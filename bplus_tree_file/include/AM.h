@@ -3,7 +3,8 @@
 
 /* Error codes */
 
-extern int AM_errno;
+/* Κάθε νήμα έχει το δικό του AM_errno */
+extern _Thread_local int AM_errno;
 
 #define AME_OK 0
 #define AME_INIT 1
@@ -26,6 +27,16 @@ extern int AM_errno;
 #define AME_TYPE 18
 #define AME_MAXSCANS 19
 #define AME_NOTOPEN 20
+#define AME_NOT_EMPTY 21
+#define AME_FILL_FACTOR 22
+#define AME_INVALID_SCAN 23
+#define AME_PAGE_SIZE 24
+#define AME_NOT_FOUND 25
+#define AME_KEY_FORMAT 26
+#define AME_COMPACT 27
+#define AME_READ_ONLY 28
+#define AME_FULL_MEMORY 29
+#define AME_CONFIG 30
 #define AME_EOF -1
 
 /* Defines for array sizes */
@@ -42,6 +53,26 @@ extern int AM_errno;
 void AM_Init( void );
 
 
+/* Ρυθμίσεις του buffer pool του επιπέδου BF, για την AM_InitWithConfig */
+#define AM_REPLACE_LRU 0
+#define AM_REPLACE_MRU 1
+
+typedef struct AM_Config {
+  int buffer_blocks;  /* block στη μνήμη, 0 για να μετρηθεί από το buffer_bytes: τουλάχιστον BF_BUFFER_SIZE, και όσα
+                         είναι πάνω από αυτά μπαίνουν στα αντίγραφα του cache_blocks */
+  long buffer_bytes;  /* bytes του buffer pool, αν buffer_blocks είναι 0 (0 και τα δύο: BF_BUFFER_SIZE block) */
+  int replacement;    /* πολιτική αντικατάστασης: AM_REPLACE_LRU ή AM_REPLACE_MRU */
+  int cache_blocks;   /* αντίγραφα block που κρατά το επίπεδο ΑΜ για τις αναζητήσεις: 0 όσα και το buffer pool, -1 κανένα */
+  int cache_shards;   /* κομμάτια των αντιγράφων, το καθένα με δικό του lock: 0 για AM_CACHE_SHARDS */
+} AM_Config;
+
+#define AM_CACHE_SHARDS 16
+
+int AM_InitWithConfig(
+  const AM_Config *config /* ρυθμίσεις του buffer pool */
+);
+
+
 int AM_CreateIndex(
   char *fileName, /* όνομα αρχείου */
   char attrType1, /* τύπος πρώτου πεδίου: 'c' (συμβολοσειρά), 'i' (ακέραιος), 'f' (πραγματικός) */
@@ -51,6 +82,16 @@ int AM_CreateIndex(
 );
 
 
+int AM_CreateIndexWithPageSize(
+  char *fileName, /* όνομα αρχείου */
+  char attrType1, /* τύπος πρώτου πεδίου: 'c' (συμβολοσειρά), 'i' (ακέραιος), 'f' (πραγματικός) */
+  int attrLength1, /* μήκος πρώτου πεδίου: 4 γιά 'i' ή 'f', 1-255 γιά 'c' */
+  char attrType2, /* τύπος πρώτου πεδίου: 'c' (συμβολοσειρά), 'i' (ακέραιος), 'f' (πραγματικός) */
+  int attrLength2, /* μήκος δεύτερου πεδίου: 4 γιά 'i' ή 'f', 1-255 γιά 'c' */
+  int pageSize /* μέγεθος σελίδας των κόμβων: πολλαπλάσιο του BF_BLOCK_SIZE, έως 16384 */
+);
+
+
 int AM_DestroyIndex(
   char *fileName /* όνομα αρχείου */
 );
@@ -61,6 +102,11 @@ int AM_OpenIndex (
 );
 
 
+int AM_OpenIndexReadOnly (
+  char *fileName /* όνομα αρχείου */
+);
+
+
 int AM_CloseIndex (
   int fileDesc /* αριθμός που αντιστοιχεί στο ανοιχτό αρχείο */
 );
@@ -72,7 +118,27 @@ int AM_InsertEntry(
   void *value2 /* τιμή του δεύτερου πεδίου της εγγραφής προς εισαγωγή */
 );
 
-int insertEntry(int fileDesc, int nodePointer, void *value1, void *value2, void* newChildEntry);
+int insertEntry(int fileDesc, void *value1, void *value2);
+
+/* Διαγράφει μόνο από αρχεία με φύλλα καταχωρήσεων (posting leaves): σε αρχείο με απλά φύλλα επιστρέφει
+   AME_KEY_FORMAT, και όσο είναι ανοιχτή μια σάρωση του αρχείου, από οποιοδήποτε AM_OpenIndex του, AME_OPEN_SCAN */
+int AM_DeleteEntry(
+  int fileDesc, /* αριθμός που αντιστοιχεί στο ανοιχτό αρχείο */
+  void *value1, /* τιμή του πεδίου-κλειδιού της εγγραφής προς διαγραφή */
+  void *value2 /* τιμή του δεύτερου πεδίου της εγγραφής προς διαγραφή */
+);
+
+int AM_BulkLoad(
+  int fileDesc, /* αριθμός που αντιστοιχεί στο ανοιχτό αρχείο */
+  void *entries, /* πίνακας από count ζεύγη (τιμή1, τιμή2), το ένα μετά το άλλο */
+  int count, /* πλήθος των ζευγών του πίνακα */
+  float fillFactor /* ποσοστό πληρότητας των κόμβων: (0, 1] */
+);
+
+int AM_Compact(
+  int fileDesc, /* αριθμός που αντιστοιχεί στο ανοιχτό αρχείο */
+  float fillFactor /* ποσοστό πληρότητας των φύλλων μετά τη συμπύκνωση: (0, 1] */
+);
 
 int AM_OpenIndexScan(
   int fileDesc, /* αριθμός που αντιστοιχεί στο ανοιχτό αρχείο */
@@ -87,11 +153,59 @@ void *AM_FindNextEntry(
 );
 
 
+int AM_FindNextBatch(
+  int scanDesc, /* αριθμός που αντιστοιχεί στην ανοιχτή σάρωση */
+  void *out, /* χώρος για maxRows τιμές του δεύτερου πεδίου */
+  int maxRows, /* μέγιστο πλήθος εγγραφών που επιστρέφονται */
+  int *nRows /* πλήθος εγγραφών που επιστράφηκαν */
+);
+
+
 int AM_CloseIndexScan(
   int scanDesc /* αριθμός που αντιστοιχεί στην ανοιχτή σάρωση */
 );
 
 
+/* Μετρητές ενός ευρετηρίου, ή όλων μαζί */
+#define AM_STATS_LEVELS 16
+
+typedef struct AM_Stats {
+  long inserts;       /* κλήσεις της AM_InsertEntry */
+  long appends;       /* εισαγωγές που πήγαν κατευθείαν στο δεξιότερο φύλλο, χωρίς να κατέβουν από τη ρίζα */
+  long deletes;       /* εγγραφές που διαγράφηκαν με την AM_DeleteEntry */
+  long bulk_entries;  /* εγγραφές που φορτώθηκαν με την AM_BulkLoad */
+  long lookups;       /* σαρώσεις που άνοιξαν με την AM_OpenIndexScan */
+  long scan_rows;     /* εγγραφές που επέστρεψαν οι σαρώσεις */
+  long splits[AM_STATS_LEVELS]; /* διασπάσεις κόμβων ανά επίπεδο: 0 τα φύλλα, 1 οι γονείς τους κ.ο.κ. */
+  long root_splits;   /* διασπάσεις της ρίζας, δηλαδή φορές που το δέντρο ψήλωσε */
+  long merges;        /* συγχωνεύσεις δύο κόμβων σε έναν, μετά από διαγραφές */
+  long freed_pages;   /* σελίδες που μπήκαν στη λίστα των ελεύθερων σελίδων */
+  long reused_pages;  /* σελίδες που πάρθηκαν από τη λίστα των ελεύθερων σελίδων αντί για νέα block */
+  long blocks_pinned; /* block που καρφώθηκαν στη μνήμη (BF_GetBlock και BF_AllocateBlock) */
+  long cached_nodes;  /* εσωτερικοί κόμβοι που διαβάστηκαν από τα αντίγραφα των ανώτερων επιπέδων */
+  long cached_blocks; /* block που διαβάστηκαν από τα αντίγραφα του επιπέδου ΑΜ, χωρίς το επίπεδο BF */
+  long prefetched_pages; /* σελίδες φύλλων που ζήτησαν οι σαρώσεις από το σύστημα πριν τις διαβάσουν */
+  long comparisons;   /* συγκρίσεις κλειδιών */
+  long bytes_copied;  /* bytes εγγραφών και σελίδων που αντιγράφηκαν */
+  int height;         /* ύψος του δέντρου, μετρώντας και τα φύλλα */
+  long leaves;        /* πλήθος φύλλων */
+  long entries;       /* πλήθος εγγραφών στα φύλλα */
+  long free_pages;    /* σελίδες που βρίσκονται στη λίστα των ελεύθερων σελίδων */
+  long leaf_jumps;    /* φύλλα των οποίων το next_leaf βρίσκεται πιο πίσω στο αρχείο, όπου μια σάρωση γυρίζει πίσω */
+  double leaf_fill;   /* μέση πληρότητα των φύλλων: (0, 1] */
+} AM_Stats;
+
+int AM_GetStats(
+  int fileDesc, /* αριθμός που αντιστοιχεί στο ανοιχτό αρχείο, ή -1 για όλα τα αρχεία */
+  AM_Stats *stats /* χώρος για τους μετρητές */
+);
+
+
+int AM_ResetStats(
+  int fileDesc /* αριθμός που αντιστοιχεί στο ανοιχτό αρχείο, ή -1 για όλα τα αρχεία */
+);
+
+
 void AM_PrintError(
   char *errString /* κείμενο για εκτύπωση */
 );
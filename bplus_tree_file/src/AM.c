@@ -1,19 +1,117 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "AM.h"
 #include "bf.h"
 
-int AM_errno = AME_OK;
+_Thread_local int AM_errno = AME_OK;
+
+/*
+ * The operations on the keys of an index, specialized for each type of key. They are chosen
+ * once, when the index is opened, so the loops that compare keys do not test attrType1 again.
+ *  compare - returns a negative number, zero or a positive number if first is lower than, equal to or bigger than second.
+ *  lowerBound - returns the position of the first of the entries keys (stride bytes apart) that is >= value.
+ *  upperBound - returns the position of the first of the entries keys (stride bytes apart) that is > value.
+ */
+struct key_traits{
+    int (*compare)(const void *first, const void *second, int attrLength);
+    int (*lowerBound)(const char *keys, int stride, int entries, const void *value, int attrLength);
+    int (*upperBound)(const char *keys, int stride, int entries, const void *value, int attrLength);
+};
+
+/*
+ * A page holds one node of the B+ Tree. It is made of page_blocks consecutive blocks of the file and it is
+ * known by the number of its first block. A page of a single block is used where it is in the buffer pool,
+ * while a bigger page is copied to buffer when it is read and back to its blocks when it is written. The copy
+ * is read again only if the page is a different one or some page has been written since it was made.
+ */
+struct page_ref{
+    int page;
+    char *data;         /* the contents of the page, while it is held */
+    BF_Block *block;
+    char *buffer;       /* page_size bytes, only for pages of more than one block */
+    unsigned int changes;   /* the value of page_changes when buffer was read */
+    int sequential;         /* the page of a scan that moves along the leaves, whose blocks are kept with low priority */
+};
+
+/*
+ * The internal nodes of the upper levels of a tree are read on every insert and every search, so an open file keeps
+ * a copy of the ones in its first CACHED_LEVELS levels, without going to the buffer pool for them. The root always
+ * has slot 0 and every other node goes to the slot of its page number, replacing the node that was there. A copy is
+ * written again whenever its page is written through pagePut, and the slot of the root is emptied when the root changes.
+ */
+#define CACHED_LEVELS 3
+#define CACHED_NODES 64
+
+struct node_cache{
+    int pages[CACHED_NODES];    /* the page that every slot holds, -1 if it is empty */
+    char *data;                 /* CACHED_NODES pages of page_size bytes */
+};
+
+/* The values of a key of a posting leaf, while a split moves them to their new leaf */
+struct posting_group{
+    const char *key;
+    const char *values;     /* the slots of the key, where the lowest one is in memory */
+    int slots;
+    const char *extra;      /* a new value that goes after the slots, or NULL */
+    int overflow;           /* the slots hold the chain of overflow pages of the key */
+};
+
+/*
+ * The latch of an open file. Searches and scans hold it shared and every operation that changes the tree holds it
+ * exclusively, so that many threads may read an index at once while a split waits for them, and the other way round.
+ * An insert that fits in its leaf holds it shared as well, together with the latch of the leaf in leaves, which it
+ * holds exclusively while it writes the leaf and a reader holds shared while it copies the leaf or moves a scan in
+ * it. So inserts to different leaves go on at the same time, and next to the searches. The leaves share
+ * LEAF_LATCHES latches by their page numbers.
+ */
+#define LEAF_LATCHES 64
+
+struct index_latch{
+    pthread_rwlock_t lock;
+    pthread_rwlock_t leaves[LEAF_LATCHES];
+    int users;                  /* the positions of the Files_array that use the latch */
+    unsigned int id;            /* the file of the copies of its blocks in the cache_shards, never used again */
+    unsigned int generation;    /* moves on each time the latch is let go after it was held exclusively */
+    int writing;                /* the latch is held exclusively, so the blocks of the file may be changing */
+    int prefetch_fd;            /* the file opened for reading by the system, for the read-ahead of scanPrefetch, or -1 */
+    int rootBlock;              /* the root of the tree, which every position that has the file open descends from */
+    struct node_cache cache;    /* the copies of the upper nodes, written by any of those positions */
+    int free_list;              /* the first page of the list of free pages of the file, 0 if there is none */
+    int append_leaf;            /* the rightmost leaf, as the last insert found it, -1 if it is not known */
+    int leaf_level;             /* the level of the leaves, as the last descend for a writer found it, -1 if it is not known */
+    char *append_key;           /* the highest key of append_leaf, as the last insert found it */
+    pthread_mutex_t cache_lock; /* taken by a reader that fills an empty slot of the node_cache */
+};
 
 struct file_info{
     char* fileName;
-    int fileDesc;
-    int rootBlock;
+    int fileDesc;               /* the file of the BF level, or the file of the system for a mapped index */
+    char *map;                  /* the whole file, for an index opened with AM_OpenIndexReadOnly, NULL otherwise */
+    size_t map_size;
+    struct index_latch *latch;  /* shared by the positions of the Files_array that have the same file open */
     char attrType1;
     char attrType2;
     int attrLength1;
     int attrLength2;
+    int page_size;
+    int page_blocks;
+    int compress_keys;          /* the internal nodes hold the keys in the layout of nodeKeys */
+    int postings;               /* the leaves are posting leaves */
+    char *page_copy;            /* space for two pages, while a split or a delete moves their entries */
+    struct posting_group *groups;   /* space for the groups of two posting leaves */
+    char *pairs;                /* space for all the entries of two internal nodes, with their keys at full length */
+    const struct key_traits *keys;
+    AM_Stats stats;
+    struct page_ref page;       /* pages that every operation on the index reuses, so that */
+    struct page_ref new_page;   /* inserts and searches do not allocate new ones each time */
 };
 
 struct scan_info{
@@ -21,866 +119,4621 @@ struct scan_info{
     int operator;
     int block;
     int position;
+    int item;           /* the next value of the key at position, in a posting leaf or in an overflow page */
+    int overflow;       /* the overflow page that is being read, -1 if none */
+    int prefetched;     /* the page up to which scanPrefetch has asked for the leaves, -1 if none */
     int fileDesc;
+    void *result;
+    struct page_ref leaf;
 };
 
 struct file_info Files_array[MAX_OPEN_FILES];
-struct scan_info Scans_array[MAX_OPEN_SCANS];
 
-int file = -1;
+/* The counters of the indexes that have been closed, so that the totals of AM_GetStats include them */
+static AM_Stats closed_stats;
 
-int node_offset = sizeof(char)+sizeof(int);
-int leaf_offset = sizeof(char)+sizeof(int)*3;
+/* Number of pages written to any file, so that the copies of pages know when they may be old.
+ * It is not kept per index, since the same file may be opened more than once. */
+static unsigned int page_changes = 0;
+struct scan_info Scans_array[MAX_OPEN_SCANS];
+
+/* The BF level is not safe for concurrent use, so every call into it holds bf_lock. The positions of the
+ * Files_array and the Scans_array are taken and given back while table_lock is held. A thread that holds
+ * a latch may take table_lock, and a thread that holds table_lock may take bf_lock, but never the other way. */
+static pthread_mutex_t bf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /**
- * AM_Init()
+ * statAdd(long *counter, long count)
  *  returns: nothing
  *
- * This function is used to initialize the global structures that are needed for the usage
- * of the B+ Tree.
+ * Adds count to a counter of AM_Stats. Threads that read the same index count at the same time, so it is atomic.
  */
-void AM_Init() {
+static void statAdd(long *counter, long count){
+    __atomic_fetch_add(counter, count, __ATOMIC_RELAXED);
+}
 
-    /* Test correct behaviour of BF_Init */
-    if (BF_Init(LRU) != BF_OK){
-        AM_errno = AME_INIT; 
-        AM_PrintError("Error while initializing the file.");
-        exit(AM_errno);
-    }
+/*
+ * The calls into the BF level, each one with bf_lock held. A block stays where it is while it is pinned,
+ * so its data are read and changed without the lock.
+ */
+static BF_ErrorCode bfCreateFile(const char *fileName){
+    pthread_mutex_lock(&bf_lock);
+    BF_ErrorCode code = BF_CreateFile(fileName);
+    pthread_mutex_unlock(&bf_lock);
+    return code;
+}
 
-    /* Initiallize the File_array */
-    for (int i = 0; i<MAX_OPEN_FILES; i++){
-        Files_array[i].fileName = NULL;
-        Files_array[i].fileDesc = -1;
-        Files_array[i].rootBlock = 0;
-        Files_array[i].attrType1 = 'l';
-        Files_array[i].attrType2 = 'l';
-        Files_array[i].attrLength1 = -1;
-        Files_array[i].attrLength2 = -1;
-    }
+static BF_ErrorCode bfOpenFile(const char *fileName, int *file_desc){
+    pthread_mutex_lock(&bf_lock);
+    BF_ErrorCode code = BF_OpenFile(fileName, file_desc);
+    pthread_mutex_unlock(&bf_lock);
+    return code;
+}
 
-    for(int i = 0; i<MAX_OPEN_SCANS; i++){
-        Scans_array[i].operator = 0;
-        Scans_array[i].value = NULL;
-        Scans_array[i].block = -1;
-        Scans_array[i].position = -1;
-        Scans_array[i].fileDesc = -1;
-    }
-	return;
+static BF_ErrorCode bfCloseFile(int file_desc){
+    pthread_mutex_lock(&bf_lock);
+    BF_ErrorCode code = BF_CloseFile(file_desc);
+    pthread_mutex_unlock(&bf_lock);
+    return code;
+}
+
+static BF_ErrorCode bfGetBlockCounter(int file_desc, int *blocks_num){
+    pthread_mutex_lock(&bf_lock);
+    BF_ErrorCode code = BF_GetBlockCounter(file_desc, blocks_num);
+    pthread_mutex_unlock(&bf_lock);
+    return code;
+}
+
+static BF_ErrorCode bfAllocateBlock(int file_desc, BF_Block *block){
+    pthread_mutex_lock(&bf_lock);
+    BF_ErrorCode code = BF_AllocateBlock(file_desc, block);
+    pthread_mutex_unlock(&bf_lock);
+    return code;
+}
+
+static BF_ErrorCode bfGetBlock(int file_desc, int block_num, BF_Block *block){
+    pthread_mutex_lock(&bf_lock);
+    BF_ErrorCode code = BF_GetBlock(file_desc, block_num, block);
+    pthread_mutex_unlock(&bf_lock);
+    return code;
 }
 
+static BF_ErrorCode bfUnpinBlock(BF_Block *block){
+    pthread_mutex_lock(&bf_lock);
+    BF_ErrorCode code = BF_UnpinBlock(block);
+    pthread_mutex_unlock(&bf_lock);
+    return code;
+}
+
+/* The last id given to an index_latch. It is taken with table_lock held, and 0 is never an id */
+static unsigned int latch_ids = 0;
+
 /**
- * AM_CreateIndex(char *fileName, char attrType1, int attrLength1, char attrType2, int attrLength2)
- *  returns: AME_OK - if it succeeds, Some other error code - if it fails
+ * latchAttach(int position)
+ *  returns: nothing
  *
- * This function creates a file with name fileName, that is based on a B+ Tree. The file must not
- * already exist. The type and length of the first field(which is used for the insertion in the B+
- * Tree as a key) are described by the second and third parameter, correnspondingly. Samewise, the
- * type and the length of the second field are described by the fourth and fifth parameter.
+ * Gives the index at position the latch of the other positions of the Files_array that have the same file
+ * open in the same way, mapped or through the BF level, or a new latch if there are none. The latch holds the
+ * root and the node_cache of the file, so that a change through one position is seen by the others. A writer that waits for the latch, or for the latch of a leaf, is let
+ * in before the readers that come after it, so a stream of searches or scans does not hold back the inserts.
+ * A thread never takes the latch of a leaf again while it holds it, which these latches do not allow.
+ * It is called with table_lock held.
  */
-int AM_CreateIndex(char *fileName, 
-	               char attrType1, 
-	               int attrLength1, 
-	               char attrType2, 
-	               int attrLength2) {
-    if((attrType1 == 'i' && attrLength1 != sizeof(int)) || (attrType1 == 'f' && attrLength1 != sizeof(float)) || (attrType1 == 'c' && (attrLength1 < 1 || attrLength1 > 255))){
-        AM_errno = AME_TYPE;
-        return AM_errno;
+static void latchAttach(int position){
+    for(int i = 0; i < MAX_OPEN_FILES; i++){
+        if(i != position && Files_array[i].latch != NULL && (Files_array[i].map == NULL) == (Files_array[position].map == NULL)
+           && strcmp(Files_array[i].fileName, Files_array[position].fileName) == 0){
+            Files_array[position].latch = Files_array[i].latch;
+            Files_array[position].latch->users++;
+            return;
+        }
     }
 
-    if((attrType2 == 'i' && attrLength2 != sizeof(int)) || (attrType2 == 'f' && attrLength2 != sizeof(float)) || (attrType2 == 'c' && (attrLength2 < 1 || attrLength2 > 255))){
-        AM_errno = AME_TYPE;
-        return AM_errno;
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    Files_array[position].latch = malloc(sizeof(struct index_latch));
+    pthread_rwlock_init(&Files_array[position].latch->lock, &attr);
+    for(int i = 0; i < LEAF_LATCHES; i++){
+        pthread_rwlock_init(&Files_array[position].latch->leaves[i], &attr);
     }
+    pthread_rwlockattr_destroy(&attr);
+    Files_array[position].latch->users = 1;
+    Files_array[position].latch->id = ++latch_ids;
+    Files_array[position].latch->generation = 0;
+    Files_array[position].latch->writing = 0;
+    Files_array[position].latch->prefetch_fd = open(Files_array[position].fileName, O_RDONLY);
+    Files_array[position].latch->rootBlock = -1;
+    Files_array[position].latch->cache.data = NULL;
+    Files_array[position].latch->free_list = 0;
+    Files_array[position].latch->append_leaf = -1;
+    Files_array[position].latch->leaf_level = -1;
+    Files_array[position].latch->append_key = NULL;
+    pthread_mutex_init(&Files_array[position].latch->cache_lock, NULL);
+}
 
-    if (BF_CreateFile(fileName) != BF_OK){
-        AM_errno = AME_CREATE_FILE;
-        return AM_errno;
-    }
-    
-    int fileDesc;
-    if(BF_OpenFile(fileName, &fileDesc) != BF_OK){
-        AM_errno = AME_OPEN_FILE;
-        return AM_errno;
+/**
+ * latchDetach(int position)
+ *  returns: nothing
+ *
+ * Takes the latch away from the index at position, when it is closed, and frees it if no other position uses it.
+ * It is called with table_lock held.
+ */
+static void latchDetach(int position){
+    struct index_latch *latch = Files_array[position].latch;
+    Files_array[position].latch = NULL;
+    if(latch != NULL && --latch->users == 0){
+        if(latch->prefetch_fd != -1){
+            close(latch->prefetch_fd);
+        }
+        pthread_rwlock_destroy(&latch->lock);
+        for(int i = 0; i < LEAF_LATCHES; i++){
+            pthread_rwlock_destroy(&latch->leaves[i]);
+        }
+        pthread_mutex_destroy(&latch->cache_lock);
+        free(latch->cache.data);
+        free(latch->append_key);
+        free(latch);
     }
+}
 
-    BF_Block *block;
-    BF_Block_Init(&block);
-    char *data;
-    if(BF_AllocateBlock(fileDesc, block) != BF_OK){
-        AM_errno = AME_ALLOCATE;
-        return AM_errno;
-    }
+static void latchShared(int fileIndex){
+    pthread_rwlock_rdlock(&Files_array[fileIndex].latch->lock);
+}
 
-    /* Make sure that there is only one block allocated in the file. */
-    int blocks_num;
-    if(BF_GetBlockCounter(fileDesc, &blocks_num) != BF_OK){
-        AM_errno = AME_COUNTER;
-        return AM_errno;
-    }
+static void latchExclusive(int fileIndex){
+    pthread_rwlock_wrlock(&Files_array[fileIndex].latch->lock);
+    Files_array[fileIndex].latch->writing = 1;
+}
 
-    if(blocks_num != 1){
-        AM_errno = AME_BLOCKS;
-        return AM_errno;
+/* Only the thread that holds the latch exclusively reads or writes writing, so the copies of blocks that were kept
+ * before it let the latch go are old once the generation has moved on */
+static void latchUnlock(struct index_latch *latch){
+    if(latch->writing){
+        latch->writing = 0;
+        latch->generation++;
     }
+    pthread_rwlock_unlock(&latch->lock);
+}
 
-    if(BF_GetBlock(fileDesc, 0, block) != BF_OK){
-        AM_errno = AME_GETBLOCK;
-        return AM_errno;
-    }
-    data = BF_Block_GetData(block);
+static void latchRelease(int fileIndex){
+    latchUnlock(Files_array[fileIndex].latch);
+}
 
-    char type = 'b';
-    int zero = 0;
-    memcpy(data, &type, sizeof(char));
-    memcpy(data+sizeof(char), &attrType1, sizeof(char));
-    memcpy(data+sizeof(char)*2, &attrLength1, sizeof(int));
-    memcpy(data+sizeof(char)*2+sizeof(int), &attrType2, sizeof(char));
-    memcpy(data+sizeof(char)*3+sizeof(int), &attrLength2, sizeof(int));
-    memcpy(data+sizeof(char)*3+sizeof(int)*2, &zero, sizeof(int));
+/**
+ * leafLatch(int fileIndex, int pageNum)
+ *  returns: the latch of the page pageNum of the index, out of the leaves of its index_latch.
+ */
+static pthread_rwlock_t *leafLatch(int fileIndex, int pageNum){
+    return &Files_array[fileIndex].latch->leaves[(pageNum/Files_array[fileIndex].page_blocks)%LEAF_LATCHES];
+}
 
-    /*
-     * The first block presentation:
-     *
-     * ['b'(shows that the file implements a B+Tree), 
-     * attrType1,
-     * attrLength1,
-     * attrType2,
-     * attrLength2, 
-     * 0(shows which block has the root of the B+Tree)]
-     */
+/* The biggest attrLength that AM_CreateIndex accepts, so a key always fits in a buffer of this size */
+#define MAX_ATTR_LENGTH 255
 
-    BF_Block_SetDirty(block);
-    if(BF_UnpinBlock(block) != BF_OK){
-        AM_errno = AME_UNPIN;
-        return AM_errno;
-    }
+/* The biggest page that an index may have. The size of a page is a multiple of BF_BLOCK_SIZE */
+#define MAX_PAGE_SIZE 16384
 
-    BF_Block_Destroy(&block);
-    BF_CloseFile(fileDesc);
-    return AME_OK;
-}
+/* The length of the prefix and the width of the suffixes, in an internal node with compressed keys */
+#define NODE_KEYS_HEADER 2
 
-/**
- * AM_DestroyIndex(char *fileName)
- *  returns: AME_OK - if it succeeds, Some other error code - if it fails
- *
- * This function destroys the file with name fileName, deleting the file from the disk.
- * The file cannot be deleted if opens of it exist in the Files_array.
+/* The bits of the keyFormat of the first block of a file: its internal nodes hold compressed 'c' keys,
+ * its leaves hold every key once with the list of its values */
+#define KEY_FORMAT_COMPRESSED 1
+#define KEY_FORMAT_POSTINGS 2
+
+/* Set in the end of a key of a posting leaf whose values are in overflow pages */
+#define OVERFLOW_FLAG 0x8000
+
+/* The percent of the entries that the first node keeps when a node is split. A split at the right end of the
+ * tree, where sequential keys keep arriving, leaves most of them there, since they are not inserted to again */
+#define EVEN_SPLIT 50
+#define APPEND_SPLIT 90
+
+int node_offset = sizeof(char)+sizeof(int);
+int leaf_offset = sizeof(char)+sizeof(int)*3;
+int posting_offset = sizeof(char)+sizeof(int)*4;
+int overflow_offset = sizeof(char)+sizeof(int)*2;
+
+/*
+ * The numeric keys are copied to local variables before they are compared, because their position
+ * inside a block is not aligned. The copies have a fixed size, so they compile to plain loads, and
+ * attrLength, which the key_traits pass for the 'c' keys, is not needed.
  */
-int AM_DestroyIndex(char *fileName) {
-    for(int i = 0; i < MAX_OPEN_FILES; i++){
-        if(strcmp(Files_array[i].fileName, fileName) == 0){
-            AM_errno = AME_DESTROY;
-            return AM_errno;
+#define NUMERIC_KEY_TRAITS(name, type) \
+static int name##Compare(const void *first, const void *second, int attrLength){ \
+    type first_value, second_value; \
+    (void)attrLength; \
+    memcpy(&first_value, first, sizeof(type)); \
+    memcpy(&second_value, second, sizeof(type)); \
+    return (first_value > second_value) - (first_value < second_value); \
+} \
+static int name##LowerBound(const char *keys, int stride, int entries, const void *value, int attrLength){ \
+    type search_value, key; \
+    (void)attrLength; \
+    memcpy(&search_value, value, sizeof(type)); \
+    int low = 0, high = entries; \
+    while(low < high){ \
+        int middle = (low+high)/2; \
+        memcpy(&key, keys+stride*middle, sizeof(type)); \
+        if(key < search_value){ \
+            low = middle+1; \
+        } else { \
+            high = middle; \
+        } \
+    } \
+    return low; \
+} \
+static int name##UpperBound(const char *keys, int stride, int entries, const void *value, int attrLength){ \
+    type search_value, key; \
+    (void)attrLength; \
+    memcpy(&search_value, value, sizeof(type)); \
+    int low = 0, high = entries; \
+    while(low < high){ \
+        int middle = (low+high)/2; \
+        memcpy(&key, keys+stride*middle, sizeof(type)); \
+        if(key <= search_value){ \
+            low = middle+1; \
+        } else { \
+            high = middle; \
+        } \
+    } \
+    return low; \
+} \
+static const struct key_traits name##_traits = { name##Compare, name##LowerBound, name##UpperBound };
+
+NUMERIC_KEY_TRAITS(int, int)
+NUMERIC_KEY_TRAITS(float, float)
+
+static int stringCompare(const void *first, const void *second, int attrLength){
+    return strncmp(first, second, attrLength);
+}
+
+static int stringLowerBound(const char *keys, int stride, int entries, const void *value, int attrLength){
+    int low = 0, high = entries;
+    while(low < high){
+        int middle = (low+high)/2;
+        if(strncmp(keys+stride*middle, value, attrLength) < 0){
+            low = middle+1;
+        } else {
+            high = middle;
         }
     }
+    return low;
+}
 
-    if(remove(fileName) == 0) {
-        printf("File removed successfully.");
-        return AME_OK;
-    } else {
-        AM_errno = AME_REMOVE;
-        return AM_errno;
+static int stringUpperBound(const char *keys, int stride, int entries, const void *value, int attrLength){
+    int low = 0, high = entries;
+    while(low < high){
+        int middle = (low+high)/2;
+        if(strncmp(keys+stride*middle, value, attrLength) <= 0){
+            low = middle+1;
+        } else {
+            high = middle;
+        }
     }
+    return low;
+}
 
-  return AME_OK;
+static const struct key_traits string_traits = { stringCompare, stringLowerBound, stringUpperBound };
+
+/**
+ * keyTraits(char attrType)
+ *  returns: the operations for the keys of type attrType.
+ */
+static const struct key_traits *keyTraits(char attrType){
+    if(attrType == 'i'){
+        return &int_traits;
+    } else if(attrType == 'f'){
+        return &float_traits;
+    }
+    return &string_traits;
 }
 
 /**
- * AN_OpenIndex(char *fileName)
- *  returns: integer - Position in the Files_array that the file is opened
- *           Some error code - if it fails.
+ * leafMaxEntries(int fileIndex)
+ *  returns: the number of entries that fit in a leaf node.
  *
- * This function opens the file with name fileName. If the file is normally
- * opened, the function returns a small, non-negative integer, which is used
- * to recognize the file. In any other case, it returns an error code.
+ * Every entry needs attrLength1 bytes in the array of the keys and attrLength2 bytes in the array of the values.
+ * The number is kept even so that a full leaf is splitted in two leafs with d entries each.
+ */
+static int leafMaxEntries(int fileIndex){
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+    int max_entries = (Files_array[fileIndex].page_size-leaf_offset)/(attrLength1+attrLength2);
+    if(max_entries%2 == 1){
+        max_entries--;
+    }
+    return max_entries;
+}
+
+/**
+ * nodeMaxEntries(int fileIndex)
+ *  returns: the number of keys that always fit in an internal node.
  *
- * There is a Files_array keeped in the memory for all the opened files. The
- * integer that is returned by the AM_OpenIndex is the position of the table
- * that corrensponds to the file that was just opened. The same file may be
- * opened many times and for each time it occupies a different position in the
- * table.
+ * An internal node holds [pointer0, key1, pointer1, ..., keyN, pointerN] after its type and entries. When the
+ * keys are compressed a node may hold more of them, but never fewer than this.
  */
-int AM_OpenIndex (char *fileName) {
-    int position = -1;
-    for(int i = 0; i < MAX_OPEN_FILES; i++){
-        if(Files_array[i].fileDesc == -1){
-            /* An empty position in the Files_array has been found */
-            position = i;
-            Files_array[i].fileName = (char*)malloc(sizeof(char)*strlen(fileName));
-            strcpy(Files_array[i].fileName, fileName);
+static int nodeMaxEntries(int fileIndex){
+    int header = node_offset+sizeof(int)+(Files_array[fileIndex].compress_keys ? NODE_KEYS_HEADER : 0);
+    return (Files_array[fileIndex].page_size-header)/(sizeof(int)+Files_array[fileIndex].attrLength1);
+}
 
-            int fileDesc;
-            if(BF_OpenFile(fileName, &fileDesc) != BF_OK){
-                AM_errno = AME_OPEN_FILE;
-                return AM_errno;
-            }
-            Files_array[i].fileDesc = fileDesc;
-
-            BF_Block *block;
-            BF_Block_Init(&block);
-            char *data;
-            
-            if(BF_GetBlock(fileDesc, 0, block) != BF_OK){
-                AM_errno = AME_GETBLOCK;
-                return AM_errno;
-            }
-            
-            data = BF_Block_GetData(block);
-            int root;
-            char attrType1, attrType2;
-            int attrLength1, attrLength2;
-            memcpy(&root, data+sizeof(char)*3+sizeof(int)*2, sizeof(int));
-            memcpy(&attrType1, data+sizeof(char), sizeof(char));
-            memcpy(&attrLength1, data+sizeof(char)*2, sizeof(int));
-            memcpy(&attrType2, data+sizeof(char)*2+sizeof(int), sizeof(char));
-            memcpy(&attrLength2, data+sizeof(char)*3+sizeof(int), sizeof(int));
-
-            if(BF_UnpinBlock(block) != BF_OK){
-                AM_errno = AME_UNPIN;
-                return AM_errno;
-            }
+/**
+ * nodeMaxDecoded(int fileIndex)
+ *  returns: the number of keys that an internal node may hold, with the smallest keys it can have.
+ */
+static int nodeMaxDecoded(int fileIndex){
+    if(!Files_array[fileIndex].compress_keys){
+        return nodeMaxEntries(fileIndex);
+    }
+    return (Files_array[fileIndex].page_size-node_offset-sizeof(int)-NODE_KEYS_HEADER)/sizeof(int);
+}
 
-            Files_array[i].rootBlock = root;
-            Files_array[i].attrType1 = attrType1;
-            Files_array[i].attrType2 = attrType2;
-            Files_array[i].attrLength1 = attrLength1;
-            Files_array[i].attrLength2 = attrLength2;
+/**
+ * nodeKeys(int fileIndex, const char *data, int *prefix, int *width)
+ *  returns: the first key of the internal node data.
+ *
+ * The keys of a node follow one another, each one with the pointer after it, so key i starts (i-1)*(width+sizeof(int))
+ * bytes after the first. Without compression every key is stored whole, so prefix is 0 and width is attrLength1.
+ * The 'c' keys of an index with compress_keys are stored as
+ *   [type][entries][P0][prefix length][width][prefix][suffix1 P1][suffix2 P2]...
+ * where prefix is common to all the keys of the node and is left out of them, and every suffix is padded with '\0'
+ * to width bytes. So a key K of the node is the prefix followed by its suffix.
+ */
+static char *nodeKeys(int fileIndex, const char *data, int *prefix, int *width){
+    if(!Files_array[fileIndex].compress_keys){
+        *prefix = 0;
+        *width = Files_array[fileIndex].attrLength1;
+        return (char *)data+node_offset+sizeof(int);
+    }
+    *prefix = (unsigned char)data[node_offset+sizeof(int)];
+    *width = (unsigned char)data[node_offset+sizeof(int)+1];
+    return (char *)data+node_offset+sizeof(int)+NODE_KEYS_HEADER+*prefix;
+}
 
-            BF_Block_Destroy(&block);
-            break;
-        }
+/**
+ * nodeChild(int fileIndex, const char *data, int position)
+ *  returns: the pointer position of the internal node data.
+ */
+static int nodeChild(int fileIndex, const char *data, int position){
+    int prefix, width, child;
+    if(position == 0){
+        memcpy(&child, data+node_offset, sizeof(int));
+        return child;
     }
+    const char *keys = nodeKeys(fileIndex, data, &prefix, &width);
+    memcpy(&child, keys+(width+sizeof(int))*(position-1)+width, sizeof(int));
+    return child;
+}
 
-    if(position != -1){
-        return position;
-    } else {
-        AM_errno = AME_OPENINDEX;
-        return AM_errno;
+/**
+ * nodeDecode(int fileIndex, const char *data, char *pairs)
+ *  returns: the number of keys of the internal node data.
+ *
+ * Writes the keys of the node, at their full length and each one followed by its pointer, to pairs.
+ */
+static int nodeDecode(int fileIndex, const char *data, char *pairs){
+    int attrLength1 = Files_array[fileIndex].attrLength1;
+    int node_entry_size = sizeof(int)+attrLength1;
+    int prefix, width, entries;
+    const char *keys = nodeKeys(fileIndex, data, &prefix, &width);
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+
+    if(!Files_array[fileIndex].compress_keys){
+        memcpy(pairs, keys, node_entry_size*entries);
+        return entries;
+    }
+    for(int i = 0; i < entries; i++){
+        char *pair = pairs+node_entry_size*i;
+        const char *key = keys+(width+sizeof(int))*i;
+        memcpy(pair, keys-prefix, prefix);
+        memcpy(pair+prefix, key, width);
+        memset(pair+prefix+width, 0, attrLength1-prefix-width);
+        memcpy(pair+attrLength1, key+width, sizeof(int));
     }
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, node_entry_size*entries);
+    return entries;
 }
 
 /**
- * AM_CloseIndex(int fileDesc)
- *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ * nodeLayout(int fileIndex, const char *pairs, int entries, int *prefix, int *width)
+ *  returns: the bytes that an internal node needs for the entries of pairs.
  *
- * This function closes the file that is defined by its parameter. It also
- * removes the entry that corrensponds to that file from the Files_array. In
- * order for the file that is defined by the parameter fileDesc to be closed
- * successfully, there must not be opened scans of it.
+ * Finds the longest prefix that all the keys have in common and the width of the longest suffix, one more
+ * byte for its '\0' unless the key fills its whole attrLength1.
  */
-int AM_CloseIndex (int fileDesc) {
-    for(int i = 0; i < MAX_OPEN_SCANS; i++){
-        if(Scans_array[i].fileDesc == fileDesc){
-            AM_errno = AME_OPEN_SCAN;
-            return AM_errno;
-        }
+static int nodeLayout(int fileIndex, const char *pairs, int entries, int *prefix, int *width){
+    int attrLength1 = Files_array[fileIndex].attrLength1;
+    int node_entry_size = sizeof(int)+attrLength1;
+
+    if(!Files_array[fileIndex].compress_keys){
+        *prefix = 0;
+        *width = attrLength1;
+        return node_offset+sizeof(int)+node_entry_size*entries;
     }
-    
-    int flag = 0;
-    for(int i=0 ; i<MAX_OPEN_FILES; i++){
-        if(Files_array[i].fileDesc == fileDesc){
-            free(Files_array[i].fileName);
-            Files_array[i].fileDesc = -1;
-            Files_array[i].rootBlock = -1;
-            Files_array[i].attrType1 = 'l';
-            Files_array[i].attrType2 = 'l';
-            Files_array[i].attrLength1 = -1;
-            Files_array[i].attrLength2 = -1;
-            flag = 1;
-        }
-    }
-
-    if(flag == 1){
-        if(BF_CloseFile(fileDesc) != BF_OK){
-            AM_errno = AME_CLOSE;
-            return AM_errno;
+
+    *prefix = (entries > 0) ? strnlen(pairs, attrLength1) : 0;
+    int longest = *prefix;
+    for(int i = 1; i < entries; i++){
+        const char *key = pairs+node_entry_size*i;
+        int j = 0;
+        while(j < *prefix && key[j] == pairs[j]){
+            j++;
+        }
+        *prefix = j;
+        int length = strnlen(key, attrLength1);
+        if(length > longest){
+            longest = length;
         }
-    }else{
-        AM_errno = AME_CLOSE_NOT_EXIST;
-        return AM_errno;
     }
-
-    return AME_OK;
+    *width = (longest < attrLength1) ? longest+1-*prefix : attrLength1-*prefix;
+    return node_offset+sizeof(int)+NODE_KEYS_HEADER+*prefix+(*width+sizeof(int))*entries;
 }
 
 /**
- * AM_InsertEntry(int fileDesc, void* value1, void* value2)
- *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ * nodeEncode(int fileIndex, char *data, const char *pairs, int entries)
+ *  returns: AME_OK - if the entries fit in the node, Some error code - if they do not fit.
  *
- * This function inserts the pair(value1, value2) at the file that is pointed by the
+ * Writes the entries of pairs, whose keys are at full length, as the keys of the internal node data.
+ * The type and the first pointer of the node are left as they are.
+ */
+static int nodeEncode(int fileIndex, char *data, const char *pairs, int entries){
+    int attrLength1 = Files_array[fileIndex].attrLength1;
+    int node_entry_size = sizeof(int)+attrLength1;
+    int prefix, width;
+
+    if(nodeLayout(fileIndex, pairs, entries, &prefix, &width) > Files_array[fileIndex].page_size){
+        AM_errno = AME_ERROR;
+        return AM_errno;
+    }
+    memcpy(data+sizeof(char), &entries, sizeof(int));
+    if(!Files_array[fileIndex].compress_keys){
+        memcpy(data+node_offset+sizeof(int), pairs, node_entry_size*entries);
+        return AME_OK;
+    }
+
+    data[node_offset+sizeof(int)] = (char)prefix;
+    data[node_offset+sizeof(int)+1] = (char)width;
+    memcpy(data+node_offset+sizeof(int)+NODE_KEYS_HEADER, pairs, prefix);
+    char *keys = data+node_offset+sizeof(int)+NODE_KEYS_HEADER+prefix;
+    for(int i = 0; i < entries; i++){
+        const char *pair = pairs+node_entry_size*i;
+        char *key = keys+(width+sizeof(int))*i;
+        memcpy(key, pair+prefix, width);
+        memcpy(key+width, pair+attrLength1, sizeof(int));
+    }
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, (width+sizeof(int))*entries);
+    return AME_OK;
+}
+
+/**
+ * separatorKey(int fileIndex, const char *left, const char *right, char *separator)
+ *  returns: nothing
+ *
+ * Writes to separator the key that the parent keeps between a node whose highest key is left and the node
+ * after it, whose lowest key is right. Without compression this is right. With compression it is the shortest
+ * beginning of right that is bigger than left, padded with '\0', so right itself when the two keys are equal.
+ */
+static void separatorKey(int fileIndex, const char *left, const char *right, char *separator){
+    int attrLength1 = Files_array[fileIndex].attrLength1;
+    memcpy(separator, right, attrLength1);
+    if(!Files_array[fileIndex].compress_keys){
+        return;
+    }
+
+    int i = 0;
+    while(i < attrLength1 && left[i] == right[i] && right[i] != '\0'){
+        i++;
+    }
+    if(i < attrLength1 && left[i] != right[i]){
+        memset(separator+i+1, 0, attrLength1-i-1);
+    }
+}
+
+/**
+ * pageInit(struct page_ref *page, int pageSize, int shared)
+ *  returns: nothing
+ *
+ * Prepares page to hold the pages of an index with pages of pageSize bytes. The page of a reader, that holds
+ * the latch of the index shared, is copied to buffer even if it is a single block, since the BF level keeps one
+ * pin for a block however many times it is pinned, and a pin would end when another reader unpins the block.
+ */
+static void pageInit(struct page_ref *page, int pageSize, int shared){
+    page->page = -1;
+    page->data = NULL;
+    page->changes = 0;
+    page->sequential = 0;
+    BF_Block_Init(&page->block);
+    page->buffer = (pageSize > BF_BLOCK_SIZE || shared) ? malloc(pageSize) : NULL;
+}
+
+static void pageDestroy(struct page_ref *page){
+    BF_Block_Destroy(&page->block);
+    free(page->buffer);
+    page->buffer = NULL;
+}
+
+/**
+ * cacheInit(int fileIndex)
+ *  returns: nothing
+ *
+ * Makes the node_cache of the index empty, with space for CACHED_NODES of its pages.
+ */
+static void cacheInit(int fileIndex){
+    struct node_cache *cache = &Files_array[fileIndex].latch->cache;
+    for(int i = 0; i < CACHED_NODES; i++){
+        cache->pages[i] = -1;
+    }
+    /* A mapped index reads its nodes where they are, so it keeps no copies of them */
+    cache->data = (Files_array[fileIndex].map != NULL) ? NULL : malloc((size_t)CACHED_NODES*Files_array[fileIndex].page_size);
+}
+
+static void cacheDestroy(int fileIndex){
+    free(Files_array[fileIndex].latch->cache.data);
+    Files_array[fileIndex].latch->cache.data = NULL;
+}
+
+/**
+ * cacheSlot(int fileIndex, int pageNum)
+ *  returns: the slot of the node_cache in which the page pageNum is kept.
+ */
+static int cacheSlot(int fileIndex, int pageNum){
+    if(pageNum == Files_array[fileIndex].latch->rootBlock){
+        return 0;
+    }
+    return 1+(pageNum/Files_array[fileIndex].page_blocks)%(CACHED_NODES-1);
+}
+
+/**
+ * cacheFind(int fileIndex, int pageNum)
+ *  returns: the copy of the page pageNum, NULL - if the node_cache does not hold it.
+ */
+static const char *cacheFind(int fileIndex, int pageNum){
+    struct node_cache *cache = &Files_array[fileIndex].latch->cache;
+    int slot = cacheSlot(fileIndex, pageNum);
+    if(cache->data == NULL || __atomic_load_n(&cache->pages[slot], __ATOMIC_ACQUIRE) != pageNum){
+        return NULL;
+    }
+    return cache->data+(size_t)slot*Files_array[fileIndex].page_size;
+}
+
+/**
+ * cacheStore(int fileIndex, int pageNum, const char *data, int shared)
+ *  returns: nothing
+ *
+ * Keeps a copy of the page pageNum, whose contents are data, in its slot of the node_cache. If shared is not 0
+ * the latch of the index is held shared, and other readers may be reading any slot that holds a page, so the
+ * copy is kept only if the slot is empty and no other reader is filling a slot at the same time.
+ */
+static void cacheStore(int fileIndex, int pageNum, const char *data, int shared){
+    struct node_cache *cache = &Files_array[fileIndex].latch->cache;
+    int slot = cacheSlot(fileIndex, pageNum);
+    if(cache->data == NULL){
+        return;
+    }
+    if(shared){
+        if(pthread_mutex_trylock(&Files_array[fileIndex].latch->cache_lock) != 0){
+            return;
+        }
+        if(cache->pages[slot] == -1){
+            memcpy(cache->data+(size_t)slot*Files_array[fileIndex].page_size, data, Files_array[fileIndex].page_size);
+            statAdd(&Files_array[fileIndex].stats.bytes_copied, Files_array[fileIndex].page_size);
+            __atomic_store_n(&cache->pages[slot], pageNum, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&Files_array[fileIndex].latch->cache_lock);
+        return;
+    }
+    cache->pages[slot] = pageNum;
+    memcpy(cache->data+(size_t)slot*Files_array[fileIndex].page_size, data, Files_array[fileIndex].page_size);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, Files_array[fileIndex].page_size);
+}
+
+/**
+ * cacheUpdate(int fileIndex, int pageNum, const char *data)
+ *  returns: nothing
+ *
+ * Called for every page that is written, so that a copy of it in the node_cache gets its new contents.
+ * The copy may be in slot 0, if the page was the root when it was kept, or in the slot of its page number.
+ */
+static void cacheUpdate(int fileIndex, int pageNum, const char *data){
+    struct node_cache *cache = &Files_array[fileIndex].latch->cache;
+    int page_size = Files_array[fileIndex].page_size;
+    int slot = 1+(pageNum/Files_array[fileIndex].page_blocks)%(CACHED_NODES-1);
+    if(__atomic_load_n(&cache->pages[0], __ATOMIC_RELAXED) == pageNum){
+        memcpy(cache->data, data, page_size);
+    }
+    if(__atomic_load_n(&cache->pages[slot], __ATOMIC_RELAXED) == pageNum){
+        memcpy(cache->data+(size_t)slot*page_size, data, page_size);
+    }
+}
+
+/**
+ * cacheForget(int fileIndex, int pageNum)
+ *  returns: nothing
+ *
+ * Empties the slots of the node_cache that hold the page pageNum, when the page stops being a node.
+ */
+static void cacheForget(int fileIndex, int pageNum){
+    struct node_cache *cache = &Files_array[fileIndex].latch->cache;
+    int slot = 1+(pageNum/Files_array[fileIndex].page_blocks)%(CACHED_NODES-1);
+    if(cache->pages[0] == pageNum){
+        cache->pages[0] = -1;
+    }
+    if(cache->pages[slot] == pageNum){
+        cache->pages[slot] = -1;
+    }
+}
+
+/**
+ * pinFailed(BF_ErrorCode code, int error)
+ *  returns: 0 - if code is BF_OK, 1 and AM_errno set - otherwise.
+ *
+ * Checks the result of a BF_GetBlock or a BF_AllocateBlock. A pool whose blocks are all pinned gives
+ * AME_FULL_MEMORY, so that a caller can tell it from a broken file, and any other error gives error.
+ */
+static int pinFailed(BF_ErrorCode code, int error){
+    if(code == BF_OK){
+        return 0;
+    }
+    AM_errno = (code == BF_FULL_MEMORY_ERROR) ? AME_FULL_MEMORY : error;
+    return 1;
+}
+
+/*
+ * The cache_shards keep copies of the blocks that blockCopy reads, so that a search or a scan that reads a block
+ * again takes it from here instead of from the BF level, whose every call holds bf_lock. The blocks are spread over
+ * the shards by a hash of their file and number, and each shard has its own lock, hash table and LRU lists, so the
+ * threads that read different blocks seldom wait for each other. A copy belongs to the index_latch of its file by
+ * its id, and it is good only while the latch is at the generation that the copy was made in: an operation that
+ * holds the latch exclusively reads past the shards and moves the generation on when it lets the latch go, and an
+ * insert that holds it shared takes the blocks it writes out of the shards with pagePut.
+ *
+ * A shard keeps its blocks in two LRU lists, so that a range scan does not push out the internal nodes that every
+ * search reads. A block comes into the cold list and goes to the hot one when it is read again, and the hot list
+ * keeps at most HOT_PERCENT percent of the slots, giving its oldest block back to the cold list. The slots are
+ * taken again from the oldest end of the cold list. The leaves that a scan moves on to are marked sequential in
+ * its page_ref: they come into the cold list at its oldest end and are not moved to the hot list by the scan,
+ * so they are the first to go after the scan has read them.
+ */
+#define HOT_PERCENT 75
+
+#define COLD_LIST 0
+#define HOT_LIST 1
+
+struct cached_block{
+    unsigned int file;          /* the id of the index_latch of the file, 0 if the slot is empty */
+    unsigned int generation;
+    int block_num;
+    int next;                   /* the next slot of the same bucket, -1 at the end */
+    int list;                   /* COLD_LIST or HOT_LIST */
+    int newer;                  /* the list of the slot, -1 at its ends */
+    int older;
+};
+
+struct cache_shard{
+    pthread_mutex_t lock;
+    int slots;
+    int hot_slots;              /* the slots in the hot list */
+    int *buckets;               /* 2*slots lists of slots, -1 if empty */
+    struct cached_block *blocks;
+    char *data;                 /* BF_BLOCK_SIZE bytes for each slot */
+    int newest[2];              /* the ends of the cold and of the hot list */
+    int oldest[2];
+} __attribute__((aligned(64)));
+
+static struct cache_shard *cache_shards = NULL;
+static int shard_count = 0;
+
+/**
+ * shardHash(unsigned int file, int block_num)
+ *  returns: the hash of the block, which picks its shard and its bucket in it.
+ */
+static unsigned int shardHash(unsigned int file, int block_num){
+    unsigned int hash = file*0x9e3779b1u ^ (unsigned int)block_num*0x85ebca6bu;
+    hash ^= hash >> 16;
+    hash *= 0x7feb352du;
+    return hash ^ (hash >> 15);
+}
+
+/**
+ * shardsInit(long blocks, int shards)
+ *  returns: nothing
+ *
+ * Makes shards empty shards with space for blocks copies of blocks between them, or none if blocks is 0.
+ */
+static void shardsInit(long blocks, int shards){
+    shard_count = (blocks > 0) ? shards : 0;
+    cache_shards = (shard_count > 0) ? aligned_alloc(64, shard_count*sizeof(struct cache_shard)) : NULL;
+    for(int i = 0; i < shard_count; i++){
+        struct cache_shard *shard = &cache_shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->slots = (int)((blocks+shards-1)/shards);
+        shard->buckets = malloc(2*shard->slots*sizeof(int));
+        shard->blocks = malloc(shard->slots*sizeof(struct cached_block));
+        shard->data = malloc((size_t)shard->slots*BF_BLOCK_SIZE);
+        for(int j = 0; j < 2*shard->slots; j++){
+            shard->buckets[j] = -1;
+        }
+        for(int j = 0; j < shard->slots; j++){
+            shard->blocks[j].file = 0;
+            shard->blocks[j].next = -1;
+            shard->blocks[j].list = COLD_LIST;
+            shard->blocks[j].newer = (j+1 < shard->slots) ? j+1 : -1;
+            shard->blocks[j].older = j-1;
+        }
+        shard->hot_slots = 0;
+        shard->oldest[COLD_LIST] = 0;
+        shard->newest[COLD_LIST] = shard->slots-1;
+        shard->oldest[HOT_LIST] = -1;
+        shard->newest[HOT_LIST] = -1;
+    }
+}
+
+static void shardsDestroy(){
+    for(int i = 0; i < shard_count; i++){
+        pthread_mutex_destroy(&cache_shards[i].lock);
+        free(cache_shards[i].buckets);
+        free(cache_shards[i].blocks);
+        free(cache_shards[i].data);
+    }
+    free(cache_shards);
+    cache_shards = NULL;
+    shard_count = 0;
+}
+
+/**
+ * shardUnlink(struct cache_shard *shard, int slot)
+ *  returns: nothing
+ *
+ * Takes the slot out of its list. The shard is locked.
+ */
+static void shardUnlink(struct cache_shard *shard, int slot){
+    struct cached_block *entry = &shard->blocks[slot];
+    if(entry->older != -1){
+        shard->blocks[entry->older].newer = entry->newer;
+    } else {
+        shard->oldest[entry->list] = entry->newer;
+    }
+    if(entry->newer != -1){
+        shard->blocks[entry->newer].older = entry->older;
+    } else {
+        shard->newest[entry->list] = entry->older;
+    }
+    shard->hot_slots -= (entry->list == HOT_LIST);
+}
+
+/**
+ * shardTouch(struct cache_shard *shard, int slot, int list, int newest)
+ *  returns: nothing
+ *
+ * Moves the slot to the newest end of list if newest is not 0, and to its oldest end otherwise. A hot list
+ * that grows past HOT_PERCENT percent of the slots gives its oldest slot to the cold list. The shard is locked.
+ */
+static void shardTouch(struct cache_shard *shard, int slot, int list, int newest){
+    struct cached_block *entry = &shard->blocks[slot];
+    shardUnlink(shard, slot);
+    entry->list = list;
+    if(newest){
+        entry->older = shard->newest[list];
+        entry->newer = -1;
+        if(shard->newest[list] != -1){
+            shard->blocks[shard->newest[list]].newer = slot;
+        } else {
+            shard->oldest[list] = slot;
+        }
+        shard->newest[list] = slot;
+    } else {
+        entry->newer = shard->oldest[list];
+        entry->older = -1;
+        if(shard->oldest[list] != -1){
+            shard->blocks[shard->oldest[list]].older = slot;
+        } else {
+            shard->newest[list] = slot;
+        }
+        shard->oldest[list] = slot;
+    }
+    if(list == HOT_LIST && ++shard->hot_slots > 1 && shard->hot_slots*100 > shard->slots*HOT_PERCENT){
+        shardTouch(shard, shard->oldest[HOT_LIST], COLD_LIST, 1);
+    }
+}
+
+/**
+ * shardFind(struct cache_shard *shard, unsigned int hash, unsigned int file, int block_num, int **link)
+ *  returns: the slot of the shard that holds the block, or -1 if there is none.
+ *
+ * Leaves in link the place that points to the slot, or the end of its bucket. The shard is locked.
+ */
+static int shardFind(struct cache_shard *shard, unsigned int hash, unsigned int file, int block_num, int **link){
+    *link = &shard->buckets[(hash/shard_count)%(2*shard->slots)];
+    while(**link != -1){
+        struct cached_block *entry = &shard->blocks[**link];
+        if(entry->file == file && entry->block_num == block_num){
+            return **link;
+        }
+        *link = &entry->next;
+    }
+    return -1;
+}
+
+/**
+ * shardsUsed(int fileIndex)
+ *  returns: 1 - if the blocks of the index are read from and kept in the cache_shards, 0 - otherwise.
+ *
+ * They are not while the latch of the index is held exclusively, as AM_Compact holds the latch of the file
+ * that it writes.
+ */
+static int shardsUsed(int fileIndex){
+    struct index_latch *latch = Files_array[fileIndex].latch;
+    return cache_shards != NULL && !latch->writing;
+}
+
+/**
+ * shardRead(struct index_latch *latch, int block_num, char *copy, int sequential)
+ *  returns: 1 - if the shards hold a copy of the block that is not old, which is copied to copy, 0 - otherwise.
+ *
+ * A block that is found goes to the newest end of the hot list, unless a scan reads it as sequential.
+ */
+static int shardRead(struct index_latch *latch, int block_num, char *copy, int sequential){
+    unsigned int hash = shardHash(latch->id, block_num);
+    struct cache_shard *shard = &cache_shards[hash%shard_count];
+    int *link;
+    pthread_mutex_lock(&shard->lock);
+    int slot = shardFind(shard, hash, latch->id, block_num, &link);
+    int found = (slot != -1 && shard->blocks[slot].generation == latch->generation);
+    if(found){
+        memcpy(copy, shard->data+(size_t)slot*BF_BLOCK_SIZE, BF_BLOCK_SIZE);
+        if(!sequential){
+            shardTouch(shard, slot, HOT_LIST, 1);
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return found;
+}
+
+/**
+ * shardKeep(struct index_latch *latch, int block_num, const char *data, int sequential)
+ *  returns: nothing
+ *
+ * Keeps a copy of the block in the cold list, in the place of an old copy of it or of the oldest block of the
+ * cold list, or of the hot list if the cold one is empty. The copy goes to the newest end of the cold list, or to
+ * its oldest end if a scan reads the block as sequential.
+ */
+static void shardKeep(struct index_latch *latch, int block_num, const char *data, int sequential){
+    unsigned int hash = shardHash(latch->id, block_num);
+    struct cache_shard *shard = &cache_shards[hash%shard_count];
+    int *link;
+    pthread_mutex_lock(&shard->lock);
+    int slot = shardFind(shard, hash, latch->id, block_num, &link);
+    if(slot == -1){
+        slot = (shard->oldest[COLD_LIST] != -1) ? shard->oldest[COLD_LIST] : shard->oldest[HOT_LIST];
+        struct cached_block *entry = &shard->blocks[slot];
+        if(entry->file != 0){
+            int *old_link;
+            shardFind(shard, shardHash(entry->file, entry->block_num), entry->file, entry->block_num, &old_link);
+            *old_link = entry->next;
+            if(link == &entry->next){
+                /* The block went after the slot in the same bucket */
+                link = old_link;
+            }
+        }
+        entry->file = latch->id;
+        entry->block_num = block_num;
+        entry->next = -1;
+        *link = slot;
+    }
+    shard->blocks[slot].generation = latch->generation;
+    memcpy(shard->data+(size_t)slot*BF_BLOCK_SIZE, data, BF_BLOCK_SIZE);
+    shardTouch(shard, slot, COLD_LIST, !sequential);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * shardForget(struct index_latch *latch, int block_num)
+ *  returns: nothing
+ *
+ * Takes the copy of the block, if there is one, out of the shards, because the block has been changed.
+ */
+static void shardForget(struct index_latch *latch, int block_num){
+    unsigned int hash = shardHash(latch->id, block_num);
+    struct cache_shard *shard = &cache_shards[hash%shard_count];
+    int *link;
+    pthread_mutex_lock(&shard->lock);
+    int slot = shardFind(shard, hash, latch->id, block_num, &link);
+    if(slot != -1){
+        *link = shard->blocks[slot].next;
+        shard->blocks[slot].file = 0;
+        shardTouch(shard, slot, COLD_LIST, 0);
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * blockCopy(int fileIndex, int block_num, BF_Block *block, char *copy, int sequential)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Copies the block block_num of the file to copy, from the cache_shards or else through block. The block is
+ * pinned, copied and unpinned with bf_lock held all along, so a reader that unpins the same block meanwhile
+ * cannot end the pin, and the copy is kept in the shards unless the latch of the index is held exclusively,
+ * with low priority if sequential is not 0.
+ */
+static int blockCopy(int fileIndex, int block_num, BF_Block *block, char *copy, int sequential){
+    struct index_latch *latch = Files_array[fileIndex].latch;
+    int shared = shardsUsed(fileIndex);
+    if(shared && shardRead(latch, block_num, copy, sequential)){
+        statAdd(&Files_array[fileIndex].stats.cached_blocks, 1);
+        return AME_OK;
+    }
+
+    int file_id = Files_array[fileIndex].fileDesc;
+    statAdd(&Files_array[fileIndex].stats.blocks_pinned, 1);
+    pthread_mutex_lock(&bf_lock);
+    if(pinFailed(BF_GetBlock(file_id, block_num, block), AME_GETBLOCK)){
+        pthread_mutex_unlock(&bf_lock);
+        return AM_errno;
+    }
+    memcpy(copy, BF_Block_GetData(block), BF_BLOCK_SIZE);
+    BF_ErrorCode code = BF_UnpinBlock(block);
+    pthread_mutex_unlock(&bf_lock);
+    if(code != BF_OK){
+        AM_errno = AME_UNPIN;
+        return AM_errno;
+    }
+    if(shared){
+        shardKeep(latch, block_num, copy, sequential);
+    }
+    return AME_OK;
+}
+
+/**
+ * pageCopy(int fileIndex, int pageNum, struct page_ref *page)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Copies the blocks of the page pageNum to the buffer of page one at a time, so none of them stays pinned, unless
+ * the buffer already holds a copy that is not old. The caller holds the latch of the page, if it may be a leaf.
+ */
+static int pageCopy(int fileIndex, int pageNum, struct page_ref *page){
+    int page_blocks = Files_array[fileIndex].page_blocks;
+
+    unsigned int changes = __atomic_load_n(&page_changes, __ATOMIC_RELAXED);
+    if(page->page == pageNum && page->data == page->buffer && page->changes == changes){
+        /* The copy of the page is still the same as its blocks */
+        return AME_OK;
+    }
+    page->page = pageNum;
+    page->changes = changes-1;
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, Files_array[fileIndex].page_size);
+    for(int i = 0; i < page_blocks; i++){
+        if(blockCopy(fileIndex, pageNum+i, page->block, page->buffer+i*BF_BLOCK_SIZE, page->sequential) != AME_OK){
+            return AM_errno;
+        }
+    }
+    page->data = page->buffer;
+    page->changes = changes;
+    return AME_OK;
+}
+
+/**
+ * pageGetHeld(int fileIndex, int pageNum, struct page_ref *page)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Like pageGet, for a caller that already holds the latch of the page, shared or exclusively.
+ */
+static int pageGetHeld(int fileIndex, int pageNum, struct page_ref *page){
+    int file_id = Files_array[fileIndex].fileDesc;
+    int page_blocks = Files_array[fileIndex].page_blocks;
+
+    if(Files_array[fileIndex].map != NULL){
+        if(pageNum < 0 || (size_t)(pageNum+page_blocks)*BF_BLOCK_SIZE > Files_array[fileIndex].map_size){
+            AM_errno = AME_GETBLOCK;
+            return AM_errno;
+        }
+        page->page = pageNum;
+        page->data = Files_array[fileIndex].map+(size_t)pageNum*BF_BLOCK_SIZE;
+        return AME_OK;
+    }
+
+    if(page->buffer == NULL){
+        page->page = pageNum;
+        statAdd(&Files_array[fileIndex].stats.blocks_pinned, 1);
+        if(pinFailed(bfGetBlock(file_id, pageNum, page->block), AME_GETBLOCK)){
+            return AM_errno;
+        }
+        page->data = BF_Block_GetData(page->block);
+        return AME_OK;
+    }
+    return pageCopy(fileIndex, pageNum, page);
+}
+
+/**
+ * pageGet(int fileIndex, int pageNum, struct page_ref *page)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Reads the page pageNum of the file, so that its contents are in page->data until pagePut is called.
+ * A page of a single block stays pinned until then, unless page has a buffer. The blocks of a bigger page, or
+ * of the page of a reader, are copied to the buffer of page by pageCopy, with the latch of the page held shared
+ * so that an insert does not change a leaf in the middle of the copy. The page of a mapped index is read where
+ * it is in the map, without the BF level and without a copy.
+ */
+static int pageGet(int fileIndex, int pageNum, struct page_ref *page){
+    if(Files_array[fileIndex].map != NULL || page->buffer == NULL){
+        return pageGetHeld(fileIndex, pageNum, page);
+    }
+
+    pthread_rwlock_t *latch = leafLatch(fileIndex, pageNum);
+    pthread_rwlock_rdlock(latch);
+    int result = pageGetHeld(fileIndex, pageNum, page);
+    pthread_rwlock_unlock(latch);
+    return result;
+}
+
+/**
+ * blockCounter(int fileIndex, int *blocks)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Stores the number of blocks of the file of the index in blocks, as the BF level or the size of the map tells.
+ */
+static int blockCounter(int fileIndex, int *blocks){
+    if(Files_array[fileIndex].map != NULL){
+        *blocks = (int)(Files_array[fileIndex].map_size/BF_BLOCK_SIZE);
+        return AME_OK;
+    }
+    if(bfGetBlockCounter(Files_array[fileIndex].fileDesc, blocks) != BF_OK){
+        AM_errno = AME_COUNTER;
+        return AM_errno;
+    }
+    return AME_OK;
+}
+
+/**
+ * pagePut(int fileIndex, struct page_ref *page, int dirty)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Releases the page that pageGet or pageAllocate gave. If dirty is not 0 the page was changed, so the blocks
+ * of a bigger page that differ from page->data are copied back and only they are marked as dirty.
+ */
+static int pagePut(int fileIndex, struct page_ref *page, int dirty){
+    int file_id = Files_array[fileIndex].fileDesc;
+    int page_blocks = Files_array[fileIndex].page_blocks;
+
+    if(Files_array[fileIndex].map != NULL){
+        if(dirty){
+            AM_errno = AME_READ_ONLY;
+            return AM_errno;
+        }
+        return AME_OK;
+    }
+
+    if(dirty){
+        page->changes = __atomic_add_fetch(&page_changes, 1, __ATOMIC_RELAXED);
+        cacheUpdate(fileIndex, page->page, page->data);
+        /* An insert that holds the latch of the index shared writes the page while readers may find its blocks */
+        for(int i = 0; shardsUsed(fileIndex) && i < page_blocks; i++){
+            shardForget(Files_array[fileIndex].latch, page->page+i);
+        }
+    }
+    if(page->buffer == NULL){
+        if(dirty){
+            BF_Block_SetDirty(page->block);
+        }
+        if(bfUnpinBlock(page->block) != BF_OK){
+            AM_errno = AME_UNPIN;
+            return AM_errno;
+        }
+        return AME_OK;
+    }
+
+    for(int i = 0; dirty && i < page_blocks; i++){
+        statAdd(&Files_array[fileIndex].stats.blocks_pinned, 1);
+        if(pinFailed(bfGetBlock(file_id, page->page+i, page->block), AME_GETBLOCK)){
+            return AM_errno;
+        }
+        char *data = BF_Block_GetData(page->block);
+        if(memcmp(data, page->buffer+i*BF_BLOCK_SIZE, BF_BLOCK_SIZE) != 0){
+            statAdd(&Files_array[fileIndex].stats.bytes_copied, BF_BLOCK_SIZE);
+            memcpy(data, page->buffer+i*BF_BLOCK_SIZE, BF_BLOCK_SIZE);
+            BF_Block_SetDirty(page->block);
+        }
+        if(bfUnpinBlock(page->block) != BF_OK){
+            AM_errno = AME_UNPIN;
+            return AM_errno;
+        }
+    }
+    return AME_OK;
+}
+
+/**
+ * writeFreeList(int fileIndex, BF_Block *block, int head)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Makes head the first page of the list of free pages, both in the latch of the file and in its first block.
+ * The first block is read through block, which must not hold a pinned block.
+ */
+static int writeFreeList(int fileIndex, BF_Block *block, int head){
+    statAdd(&Files_array[fileIndex].stats.blocks_pinned, 1);
+    if(pinFailed(bfGetBlock(Files_array[fileIndex].fileDesc, 0, block), AME_GETBLOCK)){
+        return AM_errno;
+    }
+    memcpy(BF_Block_GetData(block)+sizeof(char)*3+sizeof(int)*5, &head, sizeof(int));
+    BF_Block_SetDirty(block);
+    if(bfUnpinBlock(block) != BF_OK){
+        AM_errno = AME_UNPIN;
+        return AM_errno;
+    }
+    Files_array[fileIndex].latch->free_list = head;
+    return AME_OK;
+}
+
+/**
+ * pageReuse(int fileIndex, struct page_ref *page, int *pageNum)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Takes the first page of the list of free pages out of the list, for pageAllocate.
+ */
+static int pageReuse(int fileIndex, struct page_ref *page, int *pageNum){
+    int file_id = Files_array[fileIndex].fileDesc;
+    int next;
+
+    *pageNum = Files_array[fileIndex].latch->free_list;
+    statAdd(&Files_array[fileIndex].stats.blocks_pinned, 1);
+    if(pinFailed(bfGetBlock(file_id, *pageNum, page->block), AME_GETBLOCK)){
+        return AM_errno;
+    }
+    memcpy(&next, BF_Block_GetData(page->block)+sizeof(char), sizeof(int));
+    if(bfUnpinBlock(page->block) != BF_OK){
+        AM_errno = AME_UNPIN;
+        return AM_errno;
+    }
+    if(writeFreeList(fileIndex, page->block, next) != AME_OK){
+        return AM_errno;
+    }
+
+    page->page = *pageNum;
+    if(Files_array[fileIndex].page_blocks == 1){
+        statAdd(&Files_array[fileIndex].stats.blocks_pinned, 1);
+        if(pinFailed(bfGetBlock(file_id, *pageNum, page->block), AME_GETBLOCK)){
+            return AM_errno;
+        }
+        page->data = BF_Block_GetData(page->block);
+    } else {
+        page->data = page->buffer;
+    }
+    page->changes = __atomic_load_n(&page_changes, __ATOMIC_RELAXED)-1;
+    statAdd(&Files_array[fileIndex].stats.reused_pages, 1);
+    return AME_OK;
+}
+
+/**
+ * pageAllocate(int fileIndex, struct page_ref *page, int *pageNum)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Allocates a new page and stores its number in pageNum. The page is held in page, as if pageGet had read it,
+ * and its contents are not initialized. A page of the list of free pages is taken first, so that the file
+ * grows only when the list is empty, and otherwise the page is allocated at the end of the file.
+ */
+static int pageAllocate(int fileIndex, struct page_ref *page, int *pageNum){
+    int file_id = Files_array[fileIndex].fileDesc;
+    int page_blocks = Files_array[fileIndex].page_blocks;
+
+    if(Files_array[fileIndex].latch->free_list != 0){
+        return pageReuse(fileIndex, page, pageNum);
+    }
+    if(bfGetBlockCounter(file_id, pageNum) != BF_OK){
+        AM_errno = AME_BLOCKS;
+        return AM_errno;
+    }
+    statAdd(&Files_array[fileIndex].stats.blocks_pinned, page_blocks);
+    for(int i = 0; i < page_blocks; i++){
+        if(pinFailed(bfAllocateBlock(file_id, page->block), AME_ALLOCATE)){
+            return AM_errno;
+        }
+        if(page_blocks > 1){
+            BF_Block_SetDirty(page->block);
+            if(bfUnpinBlock(page->block) != BF_OK){
+                AM_errno = AME_UNPIN;
+                return AM_errno;
+            }
+        }
+    }
+    page->page = *pageNum;
+    page->data = (page_blocks == 1) ? BF_Block_GetData(page->block) : page->buffer;
+    /* The buffer does not hold the contents of the new page until it is written */
+    page->changes = __atomic_load_n(&page_changes, __ATOMIC_RELAXED)-1;
+    return AME_OK;
+}
+
+/**
+ * pageFree(int fileIndex, int pageNum)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Gives back the page pageNum, which no node points to any more, by putting it first in the list of the free
+ * pages of the file. The first block of a free page holds ['f'][the next free page] and the first block of the
+ * file holds the first free page, or 0 when the list is empty. The new_page of the index must not be held.
+ */
+static int pageFree(int fileIndex, int pageNum){
+    int file_id = Files_array[fileIndex].fileDesc;
+    BF_Block *block = Files_array[fileIndex].new_page.block;
+    char type = 'f';
+
+    statAdd(&Files_array[fileIndex].stats.blocks_pinned, 1);
+    if(pinFailed(bfGetBlock(file_id, pageNum, block), AME_GETBLOCK)){
+        return AM_errno;
+    }
+    memcpy(BF_Block_GetData(block), &type, sizeof(char));
+    memcpy(BF_Block_GetData(block)+sizeof(char), &Files_array[fileIndex].latch->free_list, sizeof(int));
+    BF_Block_SetDirty(block);
+    if(bfUnpinBlock(block) != BF_OK){
+        AM_errno = AME_UNPIN;
+        return AM_errno;
+    }
+
+    /* No copy of the page may be taken for the node it used to be */
+    __atomic_fetch_add(&page_changes, 1, __ATOMIC_RELAXED);
+    cacheForget(fileIndex, pageNum);
+    statAdd(&Files_array[fileIndex].stats.freed_pages, 1);
+    return writeFreeList(fileIndex, block, pageNum);
+}
+
+/**
+ * searchComparisons(int entries)
+ *  returns: the number of keys that a binary search over entries keys compares.
+ */
+static int searchComparisons(int entries){
+    int comparisons = 0;
+    while(entries > 0){
+        entries >>= 1;
+        comparisons++;
+    }
+    return comparisons;
+}
+
+/**
+ * childPosition(int fileIndex, const char *data, const void *value)
+ *  returns: the position of the pointer of the internal node data that leads to value.
+ *
+ * This is the number of keys of the node that are lower than or equal to value, since the pointer i
+ * leads to the values that are >= key i and < key i+1. The keys are in ascending order, so they are
+ * binary searched where they are stored in the block. Compressed keys are compared by their suffixes,
+ * once value is known to start with the prefix of the node.
+ */
+static int childPosition(int fileIndex, const char *data, const void *value){
+    int prefix, width, entries;
+    const char *keys = nodeKeys(fileIndex, data, &prefix, &width);
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+
+    statAdd(&Files_array[fileIndex].stats.comparisons, searchComparisons(entries));
+    if(prefix > 0){
+        /* A value that does not start with the prefix is lower or higher than all the keys */
+        int result = strncmp(value, keys-prefix, prefix);
+        if(result != 0){
+            return (result < 0) ? 0 : entries;
+        }
+    }
+    return Files_array[fileIndex].keys->upperBound(keys, sizeof(int)+width, entries, (const char *)value+prefix, width);
+}
+
+/**
+ * leafPosition(int fileIndex, const char *data, const void *value, int strict)
+ *  returns: the position of the first entry of the leaf data whose key is bigger than value,
+ *           or bigger than or equal to value if strict is 0. If there is none, the number of entries.
+ *
+ * The keys of a leaf are stored one after the other in ascending order, so they are binary searched.
+ * In a posting leaf every key is followed by its end, and the position is the one of a key.
+ */
+static int leafPosition(int fileIndex, const char *data, const void *value, int strict){
+    const struct key_traits *keys = Files_array[fileIndex].keys;
+    int attrLength1 = Files_array[fileIndex].attrLength1;
+    int entries;
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+
+    const char *leaf_keys = data+leaf_offset;
+    int stride = attrLength1;
+    if(Files_array[fileIndex].postings){
+        leaf_keys = data+posting_offset;
+        stride = attrLength1+sizeof(unsigned short);
+    }
+
+    statAdd(&Files_array[fileIndex].stats.comparisons, searchComparisons(entries));
+    if(strict){
+        return keys->upperBound(leaf_keys, stride, entries, value, attrLength1);
+    }
+    return keys->lowerBound(leaf_keys, stride, entries, value, attrLength1);
+}
+
+/**
+ * writeRoot(int fileIndex, int root)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Makes the block root the root of the B+ Tree, both in the Files_array and in the first block of the file.
+ */
+static int writeRoot(int fileIndex, int root){
+    BF_Block *block = Files_array[fileIndex].page.block;
+    char *data;
+
+    statAdd(&Files_array[fileIndex].stats.blocks_pinned, 1);
+    if(pinFailed(bfGetBlock(Files_array[fileIndex].fileDesc, 0, block), AME_GETBLOCK)){
+        return AM_errno;
+    }
+    data = BF_Block_GetData(block);
+    memcpy(data+sizeof(char)*3+sizeof(int)*2, &root, sizeof(int));
+    BF_Block_SetDirty(block);
+    if(bfUnpinBlock(block) != BF_OK){
+        AM_errno = AME_UNPIN;
+        return AM_errno;
+    }
+
+    Files_array[fileIndex].latch->rootBlock = root;
+    Files_array[fileIndex].latch->cache.pages[0] = -1;
+    return AME_OK;
+}
+
+/*
+ * The internal nodes that an insertion passes on its way from the root to a leaf. blocks[0] is the root
+ * and positions[i] is the pointer of blocks[i] that was followed, so a split can go up to the parent
+ * and put the new entry right after that pointer without searching the parent again.
+ */
+#define MAX_TREE_HEIGHT 32
+
+struct tree_path{
+    int height;
+    int blocks[MAX_TREE_HEIGHT];
+    int positions[MAX_TREE_HEIGHT];
+};
+
+/**
+ * descend(int fileIndex, const void *value, int node, struct page_ref *page, struct tree_path *path, int levels, int *leaf)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Goes down from node to the leaf that could hold value and stores its page number in leaf. Every internal
+ * node is released before the next one is read, while the leaf is left held in page, for the caller to use
+ * and release. If path is not NULL, the internal nodes are kept in it. The nodes of the first CACHED_LEVELS
+ * levels are read from the node_cache, and kept there the first time they are read. The page of the index
+ * is used only with its latch held exclusively, so any other page belongs to a reader that holds it shared.
+ * If levels is not -1, the node that is reached after levels internal nodes is taken as the leaf without
+ * being read, and page holds nothing when it returns. The caller checks that it is a leaf, when it reads it.
+ */
+static int descend(int fileIndex, const void *value, int node, struct page_ref *page, struct tree_path *path, int levels, int *leaf){
+    int shared = (page != &Files_array[fileIndex].page);
+    const char *data;
+    char type;
+
+    if(path != NULL){
+        path->height = 0;
+    }
+    for(int level = 0; ; level++){
+        int cached = 0;
+        if(level == levels){
+            *leaf = node;
+            return AME_OK;
+        }
+        if(level < CACHED_LEVELS && (data = cacheFind(fileIndex, node)) != NULL){
+            statAdd(&Files_array[fileIndex].stats.cached_nodes, 1);
+            cached = 1;
+        } else {
+            if(pageGet(fileIndex, node, page) != AME_OK){
+                return AM_errno;
+            }
+            data = page->data;
+        }
+        memcpy(&type, data, sizeof(char));
+
+        if(type == 'o' || type == 'l'){
+            if(!shared){
+                Files_array[fileIndex].latch->leaf_level = level;
+            }
+            *leaf = node;
+            return AME_OK;
+        } else if(type != 'r' && type != 'n'){
+            if(!cached){
+                pagePut(fileIndex, page, 0);
+            }
+            AM_errno = AME_ERROR;
+            return AM_errno;
+        }
+
+        int position = childPosition(fileIndex, data, value);
+        int next_node = nodeChild(fileIndex, data, position);
+
+        if(!cached){
+            if(level < CACHED_LEVELS){
+                cacheStore(fileIndex, node, data, shared);
+            }
+            if(pagePut(fileIndex, page, 0) != AME_OK){
+                return AM_errno;
+            }
+        }
+        if(next_node <= 0){
+            AM_errno = AME_ERROR;
+            return AM_errno;
+        }
+
+        if(path != NULL){
+            if(path->height == MAX_TREE_HEIGHT){
+                AM_errno = AME_ERROR;
+                return AM_errno;
+            }
+            path->blocks[path->height] = node;
+            path->positions[path->height] = position;
+            path->height++;
+        }
+        node = next_node;
+    }
+}
+
+/**
+ * scanShift(int fileIndex, int leaf, int from, int new_leaf, int shift)
+ *  returns: nothing
+ *
+ * Moves the open scans of the file of fileIndex that are at a position >= from of leaf to position+shift of new_leaf,
+ * after a writer moved the entries there. A scan keeps only its position between two calls, so without this it would
+ * return an entry again, or miss one, when an insert of another thread moves the entries of its leaf. The writer
+ * holds the latch of leaf exclusively, so no scan is in the middle of reading it (see scanNext).
+ */
+static void scanShift(int fileIndex, int leaf, int from, int new_leaf, int shift){
+    pthread_mutex_lock(&table_lock);
+    for(int i = 0; i < MAX_OPEN_SCANS; i++){
+        struct scan_info *scan = &Scans_array[i];
+        if(scan->value != NULL && Files_array[scan->fileDesc].latch == Files_array[fileIndex].latch &&
+           __atomic_load_n(&scan->block, __ATOMIC_ACQUIRE) == leaf && scan->position >= from){
+            scan->position += shift;
+            if(new_leaf != leaf){
+                scan->block = new_leaf;
+            }
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+}
+
+/**
+ * leafInsert(int fileIndex, int leaf, char *data, const void *value1, const void *value2)
+ *  returns: nothing
+ *
+ * Puts the entry (value1, value2) in the leaf data, which is the page leaf and must have space for it. The entry
+ * goes after the keys that are lower than or equal to its key, and the keys and values after it move one position
+ * to the right so that they stay in ascending order.
+ */
+static void leafInsert(int fileIndex, int leaf, char *data, const void *value1, const void *value2){
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+    int max_entries = leafMaxEntries(fileIndex);
+    char *keys = data+leaf_offset;
+    char *values = keys+max_entries*attrLength1;
+    int entries;
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+
+    int position = leafPosition(fileIndex, data, value1, 1);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, (entries-position+1)*(attrLength1+attrLength2));
+    memmove(keys+(position+1)*attrLength1, keys+position*attrLength1, (entries-position)*attrLength1);
+    memmove(values+(position+1)*attrLength2, values+position*attrLength2, (entries-position)*attrLength2);
+    memcpy(keys+position*attrLength1, value1, attrLength1);
+    memcpy(values+position*attrLength2, value2, attrLength2);
+    entries++;
+    memcpy(data+sizeof(char), &entries, sizeof(int));
+    scanShift(fileIndex, leaf, position, leaf, 1);
+}
+
+/**
+ * nodeInsert(int fileIndex, char *data, int position, const char *newchildentry)
+ *  returns: 1 - if the entry was put in the node, 0 - if the node has no space for it.
+ *
+ * Puts the <key-value, block-number> newchildentry right after the pointer position of the internal node
+ * data. Compressed keys are written again, since the prefix and the width of the node may change.
+ */
+static int nodeInsert(int fileIndex, char *data, int position, const char *newchildentry){
+    int node_entry_size = sizeof(int)+Files_array[fileIndex].attrLength1;
+    int entries;
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+
+    if(!Files_array[fileIndex].compress_keys){
+        if(entries >= nodeMaxEntries(fileIndex)){
+            return 0;
+        }
+        char *pairs = data+node_offset+sizeof(int);
+        statAdd(&Files_array[fileIndex].stats.bytes_copied, node_entry_size*(entries-position+1));
+        memmove(pairs+node_entry_size*(position+1), pairs+node_entry_size*position, node_entry_size*(entries-position));
+        memcpy(pairs+node_entry_size*position, newchildentry, node_entry_size);
+        entries++;
+        memcpy(data+sizeof(char), &entries, sizeof(int));
+        return 1;
+    }
+
+    char *pairs = Files_array[fileIndex].pairs;
+    int prefix, width;
+    if(entries >= nodeMaxDecoded(fileIndex)){
+        return 0;
+    }
+    nodeDecode(fileIndex, data, pairs);
+    memmove(pairs+node_entry_size*(position+1), pairs+node_entry_size*position, node_entry_size*(entries-position));
+    memcpy(pairs+node_entry_size*position, newchildentry, node_entry_size);
+    if(nodeLayout(fileIndex, pairs, entries+1, &prefix, &width) > Files_array[fileIndex].page_size){
+        return 0;
+    }
+    nodeEncode(fileIndex, data, pairs, entries+1);
+    return 1;
+}
+
+/**
+ * linkLeaf(int fileIndex, int leaf, int prev_leaf)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Makes prev_leaf the prev_leaf of leaf, after a split put a new leaf before it. Nothing is done if leaf is -1.
+ * The prev_leaf of a leaf is in the first block of its page, so only that block is written.
+ */
+static int linkLeaf(int fileIndex, int leaf, int prev_leaf){
+    BF_Block *block = Files_array[fileIndex].new_page.block;
+    if(leaf == -1){
+        return AME_OK;
+    }
+
+    statAdd(&Files_array[fileIndex].stats.blocks_pinned, 1);
+    if(pinFailed(bfGetBlock(Files_array[fileIndex].fileDesc, leaf, block), AME_GETBLOCK)){
+        return AM_errno;
+    }
+    memcpy(BF_Block_GetData(block)+sizeof(char)+sizeof(int)*2, &prev_leaf, sizeof(int));
+    BF_Block_SetDirty(block);
+    __atomic_fetch_add(&page_changes, 1, __ATOMIC_RELAXED);
+    if(bfUnpinBlock(block) != BF_OK){
+        AM_errno = AME_UNPIN;
+        return AM_errno;
+    }
+    return AME_OK;
+}
+
+/**
+ * splitLeaf(int fileIndex, int leaf, const void *value1, const void *value2, char *newchildentry, int share)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Splits the full leaf L, which is held in the page of the index: the first share percent of the entries stay and
+ * the rest move to a brand new leaf L2, then (value1, value2) is put in the one of the two that it belongs. The separatorKey of L
+ * and L2 and the number of the page of L2 are written to newchildentry, for the parent. Both leafs are released when it returns.
+ */
+static int splitLeaf(int fileIndex, int leaf, const void *value1, const void *value2, char *newchildentry, int share){
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+    int max_entries = leafMaxEntries(fileIndex);
+    int d = max_entries*share/100;
+    if(d < 1){
+        d = 1;
+    } else if(d > max_entries-1){
+        d = max_entries-1;
+    }
+    int new_entries = max_entries-d;
+
+    struct page_ref *page = &Files_array[fileIndex].page;
+    struct page_ref *new_page = &Files_array[fileIndex].new_page;
+    char *data = page->data;
+    char *sata;
+
+    int new_leaf;
+    if(pageAllocate(fileIndex, new_page, &new_leaf) != AME_OK){
+        pagePut(fileIndex, page, 0);
+        return AM_errno;
+    }
+    sata = new_page->data;
+
+    int next_leaf;
+    memcpy(&next_leaf, data+sizeof(char)+sizeof(int), sizeof(int));
+
+    /* A root leaf becomes a plain leaf, since a new root will be made above it */
+    char new_type = 'l';
+    memcpy(data, &new_type, sizeof(char));
+    memcpy(data+sizeof(char), &d, sizeof(int));
+    memcpy(data+sizeof(char)+sizeof(int), &new_leaf, sizeof(int));
+
+    memcpy(sata, &new_type, sizeof(char));
+    memcpy(sata+sizeof(char), &new_entries, sizeof(int));
+    memcpy(sata+sizeof(char)+sizeof(int), &next_leaf, sizeof(int));
+    memcpy(sata+sizeof(char)+sizeof(int)*2, &leaf, sizeof(int));
+
+    /* The keys and the values after the first d move to the start of the arrays of L2 */
+    char *keys = data+leaf_offset, *new_keys = sata+leaf_offset;
+    memcpy(new_keys, keys+d*attrLength1, new_entries*attrLength1);
+    memcpy(new_keys+max_entries*attrLength1, keys+max_entries*attrLength1+d*attrLength2, new_entries*attrLength2);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, new_entries*(attrLength1+attrLength2));
+    statAdd(&Files_array[fileIndex].stats.comparisons, 1);
+    scanShift(fileIndex, leaf, d, new_leaf, -d);
+
+    if(Files_array[fileIndex].keys->compare(value1, new_keys, attrLength1) < 0){
+        leafInsert(fileIndex, leaf, data, value1, value2);
+    } else {
+        leafInsert(fileIndex, new_leaf, sata, value1, value2);
+    }
+
+    int entries;
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+    separatorKey(fileIndex, keys+(entries-1)*attrLength1, new_keys, newchildentry);
+    memcpy(newchildentry+attrLength1, &new_leaf, sizeof(int));
+
+    if(pagePut(fileIndex, page, 1) != AME_OK || pagePut(fileIndex, new_page, 1) != AME_OK){
+        return AM_errno;
+    }
+    return linkLeaf(fileIndex, next_leaf, new_leaf);
+}
+
+/*
+ * The leaves of an index with KEY_FORMAT_POSTINGS hold every key once, with the list of its values:
+ *   [type][keys][next_leaf][prev_leaf][values] | [key1 end1][key2 end2]... | free space | values
+ * The keys, each one followed by an unsigned short end, grow from the start of the page, while the slots of the
+ * values grow from its end towards the start, so slot j is the j-th attrLength2 bytes before the end of the page.
+ * The values of key i are in the slots end(i-1) to end(i)-1, so adding a key or a value only moves the keys and
+ * the values that come after it, and all the duplicates of a key are read from a single leaf.
+ *
+ * A key whose values would take more than postingHotBytes keeps them in a chain of overflow pages instead:
+ *   [type 'v'][count][next] | values
+ * Its end has the OVERFLOW_FLAG and its slots hold the first and the last page of the chain.
+ */
+
+static int postingStride(int fileIndex){
+    return Files_array[fileIndex].attrLength1+sizeof(unsigned short);
+}
+
+/**
+ * postingEnd(int fileIndex, const char *data, int position)
+ *  returns: the end of the key position of the posting leaf data, with its OVERFLOW_FLAG.
+ */
+static int postingEnd(int fileIndex, const char *data, int position){
+    unsigned short end;
+    memcpy(&end, data+posting_offset+postingStride(fileIndex)*position+Files_array[fileIndex].attrLength1, sizeof(unsigned short));
+    return end;
+}
+
+static void postingSetEnd(int fileIndex, char *data, int position, int end){
+    unsigned short value = (unsigned short)end;
+    memcpy(data+posting_offset+postingStride(fileIndex)*position+Files_array[fileIndex].attrLength1, &value, sizeof(unsigned short));
+}
+
+/**
+ * postingRun(int fileIndex, const char *data, int position, int *start, int *end)
+ *  returns: 1 - if the values of the key position are in overflow pages, 0 - if they are in the leaf.
+ *
+ * Stores the first slot of the key position of the posting leaf data in start and the slot after its last in end.
+ */
+static int postingRun(int fileIndex, const char *data, int position, int *start, int *end){
+    int value = postingEnd(fileIndex, data, position);
+    *start = (position == 0) ? 0 : (postingEnd(fileIndex, data, position-1) & ~OVERFLOW_FLAG);
+    *end = value & ~OVERFLOW_FLAG;
+    return (value & OVERFLOW_FLAG) != 0;
+}
+
+/**
+ * postingSlot(int fileIndex, const char *data, int slot)
+ *  returns: the value in the slot of the posting leaf data.
+ */
+static char *postingSlot(int fileIndex, const char *data, int slot){
+    return (char *)data+Files_array[fileIndex].page_size-(slot+1)*Files_array[fileIndex].attrLength2;
+}
+
+/**
+ * postingFree(int fileIndex, const char *data)
+ *  returns: the bytes of the posting leaf data that neither its keys nor its values use.
+ */
+static int postingFree(int fileIndex, const char *data){
+    int entries, slots;
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+    memcpy(&slots, data+leaf_offset, sizeof(int));
+    return Files_array[fileIndex].page_size-posting_offset-entries*postingStride(fileIndex)-slots*Files_array[fileIndex].attrLength2;
+}
+
+/**
+ * postingHotBytes(int fileIndex)
+ *  returns: the most bytes that the values of a key may take in a posting leaf.
+ *
+ * A quarter of the leaf, so that a split always has keys to move, but at least enough for the slots of a chain.
+ */
+static int postingHotBytes(int fileIndex){
+    int attrLength2 = Files_array[fileIndex].attrLength2;
+    int hot = (Files_array[fileIndex].page_size-posting_offset)/4;
+    return (hot > (int)sizeof(int)*2+attrLength2*2) ? hot : (int)sizeof(int)*2+attrLength2*2;
+}
+
+/**
+ * overflowSlots(int fileIndex)
+ *  returns: the slots that hold the first and the last page of a chain of overflow pages.
+ */
+static int overflowSlots(int fileIndex){
+    int attrLength2 = Files_array[fileIndex].attrLength2;
+    return (sizeof(int)*2+attrLength2-1)/attrLength2;
+}
+
+/**
+ * overflowRecord(int fileIndex, const char *data, int start)
+ *  returns: the first and the last page of the chain of a key whose first slot is start, one after the other.
+ */
+static char *overflowRecord(int fileIndex, const char *data, int start){
+    return postingSlot(fileIndex, data, start+overflowSlots(fileIndex)-1);
+}
+
+/**
+ * postingInsertSlot(int fileIndex, char *data, int slot, const void *value)
+ *  returns: nothing
+ *
+ * Puts value in the slot of the posting leaf data, after moving the slots from there on by one.
+ * The ends of the keys are left as they are.
+ */
+static void postingInsertSlot(int fileIndex, char *data, int slot, const void *value){
+    int attrLength2 = Files_array[fileIndex].attrLength2;
+    int slots;
+    memcpy(&slots, data+leaf_offset, sizeof(int));
+
+    char *last = postingSlot(fileIndex, data, slots-1);
+    memmove(last-attrLength2, last, (slots-slot)*attrLength2);
+    memcpy(postingSlot(fileIndex, data, slot), value, attrLength2);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, (slots-slot+1)*attrLength2);
+    slots++;
+    memcpy(data+leaf_offset, &slots, sizeof(int));
+}
+
+/**
+ * postingRemoveSlots(int fileIndex, char *data, int slot, int count)
+ *  returns: nothing
+ *
+ * Removes count slots of the posting leaf data from slot on, moving the slots after them back.
+ */
+static void postingRemoveSlots(int fileIndex, char *data, int slot, int count){
+    int attrLength2 = Files_array[fileIndex].attrLength2;
+    int slots;
+    memcpy(&slots, data+leaf_offset, sizeof(int));
+
+    char *last = postingSlot(fileIndex, data, slots-1);
+    memmove(last+count*attrLength2, last, (slots-slot-count)*attrLength2);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, (slots-slot-count)*attrLength2);
+    slots -= count;
+    memcpy(data+leaf_offset, &slots, sizeof(int));
+}
+
+/**
+ * postingShiftEnds(int fileIndex, char *data, int position, int count)
+ *  returns: nothing
+ *
+ * Adds count to the ends of the keys of the posting leaf data from position on.
+ */
+static void postingShiftEnds(int fileIndex, char *data, int position, int count){
+    int entries;
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+    for(int i = position; i < entries; i++){
+        postingSetEnd(fileIndex, data, i, postingEnd(fileIndex, data, i)+count);
+    }
+}
+
+/**
+ * overflowCreate(int fileIndex, int leaf, char *data, int position, const void *value2)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Moves the values of the key position of the posting leaf data, which is the page leaf, together with value2, to
+ * a new overflow page, and leaves only the first and the last page of the chain in the slots of the key. A scan
+ * that is in the middle of those values goes on from the same value in the overflow page.
+ */
+static int overflowCreate(int fileIndex, int leaf, char *data, int position, const void *value2){
+    int attrLength2 = Files_array[fileIndex].attrLength2;
+    struct page_ref *over = &Files_array[fileIndex].new_page;
+    int start, end;
+    postingRun(fileIndex, data, position, &start, &end);
+
+    int first;
+    if(pageAllocate(fileIndex, over, &first) != AME_OK){
+        return AM_errno;
+    }
+    char type = 'v';
+    int count = end-start+1;
+    int next = -1;
+    memcpy(over->data, &type, sizeof(char));
+    memcpy(over->data+sizeof(char), &count, sizeof(int));
+    memcpy(over->data+sizeof(char)+sizeof(int), &next, sizeof(int));
+    for(int i = start; i < end; i++){
+        memcpy(over->data+overflow_offset+(i-start)*attrLength2, postingSlot(fileIndex, data, i), attrLength2);
+    }
+    memcpy(over->data+overflow_offset+(count-1)*attrLength2, value2, attrLength2);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, count*attrLength2);
+    if(pagePut(fileIndex, over, 1) != AME_OK){
+        return AM_errno;
+    }
+
+    /* The values leave the leaf, except for the slots that hold the chain */
+    int slots = overflowSlots(fileIndex);
+    postingRemoveSlots(fileIndex, data, start+slots, end-start-slots);
+    postingShiftEnds(fileIndex, data, position+1, -(end-start-slots));
+    postingSetEnd(fileIndex, data, position, (start+slots) | OVERFLOW_FLAG);
+    char *record = overflowRecord(fileIndex, data, start);
+    memcpy(record, &first, sizeof(int));
+    memcpy(record+sizeof(int), &first, sizeof(int));
+
+    pthread_mutex_lock(&table_lock);
+    for(int i = 0; i < MAX_OPEN_SCANS; i++){
+        struct scan_info *scan = &Scans_array[i];
+        if(scan->value != NULL && Files_array[scan->fileDesc].latch == Files_array[fileIndex].latch &&
+           scan->block == leaf && scan->position == position && scan->item > 0){
+            scan->overflow = first;
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+    return AME_OK;
+}
+
+/**
+ * overflowAppend(int fileIndex, char *data, int position, const void *value2)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Adds value2 to the end of the chain of overflow pages of the key position of the posting leaf data.
+ * When the last page is full a new one is linked after it and becomes the last page of the key.
+ */
+static int overflowAppend(int fileIndex, char *data, int position, const void *value2){
+    int attrLength2 = Files_array[fileIndex].attrLength2;
+    int max_values = (Files_array[fileIndex].page_size-overflow_offset)/attrLength2;
+    struct page_ref *over = &Files_array[fileIndex].new_page;
+    int start, end, last, count;
+    postingRun(fileIndex, data, position, &start, &end);
+    char *record = overflowRecord(fileIndex, data, start);
+    memcpy(&last, record+sizeof(int), sizeof(int));
+
+    if(pageGet(fileIndex, last, over) != AME_OK){
+        return AM_errno;
+    }
+    memcpy(&count, over->data+sizeof(char), sizeof(int));
+    if(count < max_values){
+        memcpy(over->data+overflow_offset+count*attrLength2, value2, attrLength2);
+        count++;
+        memcpy(over->data+sizeof(char), &count, sizeof(int));
+        return pagePut(fileIndex, over, 1);
+    }
+    if(pagePut(fileIndex, over, 0) != AME_OK){
+        return AM_errno;
+    }
+
+    int new_last;
+    if(pageAllocate(fileIndex, over, &new_last) != AME_OK){
+        return AM_errno;
+    }
+    char type = 'v';
+    int next = -1;
+    count = 1;
+    memcpy(over->data, &type, sizeof(char));
+    memcpy(over->data+sizeof(char), &count, sizeof(int));
+    memcpy(over->data+sizeof(char)+sizeof(int), &next, sizeof(int));
+    memcpy(over->data+overflow_offset, value2, attrLength2);
+    if(pagePut(fileIndex, over, 1) != AME_OK){
+        return AM_errno;
+    }
+
+    if(pageGet(fileIndex, last, over) != AME_OK){
+        return AM_errno;
+    }
+    memcpy(over->data+sizeof(char)+sizeof(int), &new_last, sizeof(int));
+    if(pagePut(fileIndex, over, 1) != AME_OK){
+        return AM_errno;
+    }
+    memcpy(record+sizeof(int), &new_last, sizeof(int));
+    return AME_OK;
+}
+
+/**
+ * postingInsert(int fileIndex, int leaf, char *data, const void *value1, const void *value2, int *full)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Adds value2 to the values of the key value1 in the posting leaf data, which is the page leaf, or adds the key with value2 as its only
+ * value, after the keys that are lower than it. A key that gets too many values moves them to overflow pages.
+ * If the leaf has no space for what has to be added, it is left as it is and full is set to 1.
+ */
+static int postingInsert(int fileIndex, int leaf, char *data, const void *value1, const void *value2, int *full){
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+    int stride = postingStride(fileIndex);
+    int entries, start, end;
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+
+    *full = 0;
+    int position = leafPosition(fileIndex, data, value1, 0);
+    char *key = data+posting_offset+stride*position;
+    statAdd(&Files_array[fileIndex].stats.comparisons, 1);
+    if(position < entries && Files_array[fileIndex].keys->compare(key, value1, attrLength1) == 0){
+        if(postingRun(fileIndex, data, position, &start, &end)){
+            return overflowAppend(fileIndex, data, position, value2);
+        }
+        if((end-start+1)*attrLength2 > postingHotBytes(fileIndex)){
+            return overflowCreate(fileIndex, leaf, data, position, value2);
+        }
+        if(postingFree(fileIndex, data) < attrLength2){
+            *full = 1;
+            return AME_OK;
+        }
+        /* The duplicates of a key stay in the order they were inserted */
+        postingInsertSlot(fileIndex, data, end, value2);
+        postingShiftEnds(fileIndex, data, position, 1);
+        return AME_OK;
+    }
+
+    if(postingFree(fileIndex, data) < stride+attrLength2){
+        *full = 1;
+        return AME_OK;
+    }
+    start = (position == 0) ? 0 : (postingEnd(fileIndex, data, position-1) & ~OVERFLOW_FLAG);
+    memmove(key+stride, key, (entries-position)*stride);
+    memcpy(key, value1, attrLength1);
+    postingSetEnd(fileIndex, data, position, start);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, (entries-position+1)*stride);
+    entries++;
+    memcpy(data+sizeof(char), &entries, sizeof(int));
+
+    postingInsertSlot(fileIndex, data, start, value2);
+    postingShiftEnds(fileIndex, data, position, 1);
+    scanShift(fileIndex, leaf, position, leaf, 1);
+    return AME_OK;
+}
+
+/**
+ * postingLocal(int fileIndex, const char *data, const void *value1)
+ *  returns: 1 - if postingInsert of the key value1 to the posting leaf data changes only the leaf, 0 - if it does not.
+ *
+ * The values of a key that are in overflow pages, or that go there with one more value, are written outside the leaf.
+ */
+static int postingLocal(int fileIndex, const char *data, const void *value1){
+    int entries, start, end;
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+    int position = leafPosition(fileIndex, data, value1, 0);
+    if(position == entries || Files_array[fileIndex].keys->compare(data+posting_offset+postingStride(fileIndex)*position,
+                                                                   value1, Files_array[fileIndex].attrLength1) != 0){
+        return 1;
+    }
+    if(postingRun(fileIndex, data, position, &start, &end)){
+        return 0;
+    }
+    return (end-start+1)*Files_array[fileIndex].attrLength2 <= postingHotBytes(fileIndex);
+}
+
+/**
+ * postingRemoveKey(int fileIndex, char *data, int position)
+ *  returns: nothing
+ *
+ * Removes the key position of the posting leaf data together with its slots.
+ */
+static void postingRemoveKey(int fileIndex, char *data, int position){
+    int stride = postingStride(fileIndex);
+    int entries, start, end;
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+    postingRun(fileIndex, data, position, &start, &end);
+
+    postingRemoveSlots(fileIndex, data, start, end-start);
+    postingShiftEnds(fileIndex, data, position+1, -(end-start));
+    char *key = data+posting_offset+stride*position;
+    memmove(key, key+stride, (entries-position-1)*stride);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, (entries-position-1)*stride);
+    entries--;
+    memcpy(data+sizeof(char), &entries, sizeof(int));
+}
+
+/**
+ * overflowCollapse(int fileIndex, char *data, int position)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Moves the values of the key position of the posting leaf data back to the leaf, when its chain of overflow
+ * pages is a single page with at most half of postingHotBytes of values and the leaf has space for them.
+ * Otherwise the chain is left as it is. Half, so that a key does not go back and forth between the two.
+ */
+static int overflowCollapse(int fileIndex, char *data, int position){
+    int attrLength2 = Files_array[fileIndex].attrLength2;
+    struct page_ref *over = &Files_array[fileIndex].new_page;
+    int slots = overflowSlots(fileIndex);
+    int start, end, first, count;
+    postingRun(fileIndex, data, position, &start, &end);
+    memcpy(&first, overflowRecord(fileIndex, data, start), sizeof(int));
+
+    if(pageGet(fileIndex, first, over) != AME_OK){
+        return AM_errno;
+    }
+    memcpy(&count, over->data+sizeof(char), sizeof(int));
+    if(count*attrLength2 > postingHotBytes(fileIndex)/2 || postingFree(fileIndex, data) < (count-slots)*attrLength2){
+        return pagePut(fileIndex, over, 0);
+    }
+
+    /* The values take the place of the slots that held the chain */
+    postingRemoveSlots(fileIndex, data, start, slots);
+    for(int i = 0; i < count; i++){
+        postingInsertSlot(fileIndex, data, start+i, over->data+overflow_offset+i*attrLength2);
+    }
+    postingShiftEnds(fileIndex, data, position+1, count-slots);
+    postingSetEnd(fileIndex, data, position, start+count);
+    if(pagePut(fileIndex, over, 0) != AME_OK){
+        return AM_errno;
+    }
+    return pageFree(fileIndex, first);
+}
+
+/**
+ * overflowRemove(int fileIndex, char *data, int position, const void *value2, int *found)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Removes value2 from the chain of overflow pages of the key position of the posting leaf data and sets found to 1,
+ * or to 0 if the chain does not hold it. A page that is left empty is taken out of the chain and freed, and the key
+ * is removed when its chain is empty.
+ */
+static int overflowRemove(int fileIndex, char *data, int position, const void *value2, int *found){
+    int attrLength2 = Files_array[fileIndex].attrLength2;
+    const struct key_traits *values = keyTraits(Files_array[fileIndex].attrType2);
+    struct page_ref *over = &Files_array[fileIndex].new_page;
+    int start, end, first, last, count, next, i = 0;
+    postingRun(fileIndex, data, position, &start, &end);
+    char *record = overflowRecord(fileIndex, data, start);
+    memcpy(&first, record, sizeof(int));
+    memcpy(&last, record+sizeof(int), sizeof(int));
+
+    int prev = -1, current = first;
+    while(current != -1){
+        if(pageGet(fileIndex, current, over) != AME_OK){
+            return AM_errno;
+        }
+        memcpy(&count, over->data+sizeof(char), sizeof(int));
+        memcpy(&next, over->data+sizeof(char)+sizeof(int), sizeof(int));
+        for(i = 0; i < count; i++){
+            if(values->compare(over->data+overflow_offset+i*attrLength2, value2, attrLength2) == 0){
+                break;
+            }
+        }
+        if(i < count){
+            break;
+        }
+        if(pagePut(fileIndex, over, 0) != AME_OK){
+            return AM_errno;
+        }
+        prev = current;
+        current = next;
+    }
+    *found = (current != -1);
+    if(!*found){
+        return AME_OK;
+    }
+
+    char *page_values = over->data+overflow_offset;
+    memmove(page_values+i*attrLength2, page_values+(i+1)*attrLength2, (count-i-1)*attrLength2);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, (count-i-1)*attrLength2);
+    count--;
+    memcpy(over->data+sizeof(char), &count, sizeof(int));
+    if(pagePut(fileIndex, over, count > 0) != AME_OK){
+        return AM_errno;
+    }
+
+    if(count == 0){
+        /* The empty page leaves the chain */
+        if(prev == -1){
+            first = next;
+        } else {
+            if(pageGet(fileIndex, prev, over) != AME_OK){
+                return AM_errno;
+            }
+            memcpy(over->data+sizeof(char)+sizeof(int), &next, sizeof(int));
+            if(pagePut(fileIndex, over, 1) != AME_OK){
+                return AM_errno;
+            }
+        }
+        if(last == current){
+            last = prev;
+        }
+        memcpy(record, &first, sizeof(int));
+        memcpy(record+sizeof(int), &last, sizeof(int));
+        if(pageFree(fileIndex, current) != AME_OK){
+            return AM_errno;
+        }
+        if(first == -1){
+            postingRemoveKey(fileIndex, data, position);
+            return AME_OK;
+        }
+    }
+    if(first != last){
+        return AME_OK;
+    }
+    return overflowCollapse(fileIndex, data, position);
+}
+
+/**
+ * postingRemove(int fileIndex, char *data, const void *value1, const void *value2, int *found)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Removes the entry (value1, value2) from the posting leaf data and sets found to 1, or to 0 if the leaf does not
+ * hold it. The values are compared like keys of their type. A key whose last value is removed leaves the leaf.
+ */
+static int postingRemove(int fileIndex, char *data, const void *value1, const void *value2, int *found){
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+    const struct key_traits *values = keyTraits(Files_array[fileIndex].attrType2);
+    int entries, start, end;
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+
+    *found = 0;
+    int position = leafPosition(fileIndex, data, value1, 0);
+    statAdd(&Files_array[fileIndex].stats.comparisons, 1);
+    if(position == entries || Files_array[fileIndex].keys->compare(data+posting_offset+postingStride(fileIndex)*position, value1, attrLength1) != 0){
+        return AME_OK;
+    }
+    if(postingRun(fileIndex, data, position, &start, &end)){
+        return overflowRemove(fileIndex, data, position, value2, found);
+    }
+
+    int slot = start;
+    while(slot < end && values->compare(postingSlot(fileIndex, data, slot), value2, attrLength2) != 0){
+        slot++;
+    }
+    if(slot == end){
+        return AME_OK;
+    }
+    *found = 1;
+    if(end-start == 1){
+        postingRemoveKey(fileIndex, data, position);
+        return AME_OK;
+    }
+    postingRemoveSlots(fileIndex, data, slot, 1);
+    postingShiftEnds(fileIndex, data, position, -1);
+    return AME_OK;
+}
+
+/**
+ * postingBytes(int fileIndex, const struct posting_group *group)
+ *  returns: the bytes that group takes in a posting leaf.
+ */
+static int postingBytes(int fileIndex, const struct posting_group *group){
+    return postingStride(fileIndex)+(group->slots+(group->extra != NULL))*Files_array[fileIndex].attrLength2;
+}
+
+/**
+ * postingEncode(int fileIndex, char *data, const struct posting_group *groups, int count)
+ *  returns: nothing
+ *
+ * Writes the count groups as the keys and the values of the posting leaf data. The type, next_leaf and
+ * prev_leaf of the leaf are left as they are.
+ */
+static void postingEncode(int fileIndex, char *data, const struct posting_group *groups, int count){
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+    int stride = postingStride(fileIndex);
+    int slot = 0;
+
+    for(int i = 0; i < count; i++){
+        const struct posting_group *group = &groups[i];
+        memcpy(data+posting_offset+stride*i, group->key, attrLength1);
+        /* The slots of a key are in memory from the last one to the first one */
+        memcpy(postingSlot(fileIndex, data, slot+group->slots-1), group->values, group->slots*attrLength2);
+        slot += group->slots;
+        if(group->extra != NULL){
+            memcpy(postingSlot(fileIndex, data, slot), group->extra, attrLength2);
+            slot++;
+        }
+        postingSetEnd(fileIndex, data, i, group->overflow ? (slot | OVERFLOW_FLAG) : slot);
+    }
+    memcpy(data+sizeof(char), &count, sizeof(int));
+    memcpy(data+leaf_offset, &slot, sizeof(int));
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, count*stride+slot*attrLength2);
+}
+
+/**
+ * postingHalf(int fileIndex, const struct posting_group *groups, int count, int share)
+ *  returns: the number of the groups that go to the first of two posting leaves, -1 - if they cannot be shared.
+ *
+ * The first leaf gets the first groups and the second one the rest, so that the first leaf gets as close to
+ * share percent of the bytes as it can and both of them fit in a page. With EVEN_SPLIT the bigger of the two
+ * leaves is as small as it can be.
+ */
+static int postingHalf(int fileIndex, const struct posting_group *groups, int count, int share){
+    int space = Files_array[fileIndex].page_size-posting_offset;
+    int total = 0, half = -1;
+    long best = 0;
+    for(int i = 0; i < count; i++){
+        total += postingBytes(fileIndex, &groups[i]);
+    }
+    for(int i = 1, left = postingBytes(fileIndex, &groups[0]); i < count; left += postingBytes(fileIndex, &groups[i]), i++){
+        long distance = labs(100L*left-(long)share*total);
+        if(left <= space && total-left <= space && (half == -1 || distance < best)){
+            half = i;
+            best = distance;
+        }
+    }
+    return half;
+}
+
+/**
+ * postingSplit(int fileIndex, int leaf, const void *value1, const void *value2, char *newchildentry, int share)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Splits the full posting leaf L, which is held in the page of the index, like splitLeaf does. The keys of L and
+ * (value1, value2) are taken as groups of a key and its values, and the groups are shared by L and a new leaf L2
+ * so that L keeps about share percent of the bytes. The values of a key are never shared, so the separatorKey of the
+ * last key of L and the first key of L2 always tells them apart.
+ */
+static int postingSplit(int fileIndex, int leaf, const void *value1, const void *value2, char *newchildentry, int share){
+    int attrLength1 = Files_array[fileIndex].attrLength1;
+    int stride = postingStride(fileIndex);
+
+    struct page_ref *page = &Files_array[fileIndex].page;
+    struct page_ref *new_page = &Files_array[fileIndex].new_page;
+    char *copy = Files_array[fileIndex].page_copy;
+    struct posting_group *groups = Files_array[fileIndex].groups;
+
+    /* The groups point to a copy of L, since L is written again */
+    memcpy(copy, page->data, Files_array[fileIndex].page_size);
+    int entries, next_leaf, prev_leaf;
+    memcpy(&entries, copy+sizeof(char), sizeof(int));
+    memcpy(&next_leaf, copy+sizeof(char)+sizeof(int), sizeof(int));
+    memcpy(&prev_leaf, copy+sizeof(char)+sizeof(int)*2, sizeof(int));
+
+    int position = leafPosition(fileIndex, copy, value1, 0);
+    int count = 0;
+    for(int i = 0; i < entries; i++){
+        int start, end;
+        if(i == position && Files_array[fileIndex].keys->compare(copy+posting_offset+stride*i, value1, attrLength1) != 0){
+            struct posting_group group = { value1, value2, 1, NULL, 0 };
+            groups[count++] = group;
+        }
+        struct posting_group *group = &groups[count++];
+        group->overflow = postingRun(fileIndex, copy, i, &start, &end);
+        group->key = copy+posting_offset+stride*i;
+        group->values = postingSlot(fileIndex, copy, end-1);
+        group->slots = end-start;
+        group->extra = (i == position && Files_array[fileIndex].keys->compare(group->key, value1, attrLength1) == 0) ? value2 : NULL;
+    }
+    if(position == entries){
+        struct posting_group group = { value1, value2, 1, NULL, 0 };
+        groups[count++] = group;
+    }
+
+    int half = postingHalf(fileIndex, groups, count, share);
+    if(half == -1){
+        /* A single key with values that do not fit in a leaf */
+        pagePut(fileIndex, page, 0);
+        AM_errno = AME_INSERT_ERROR;
+        return AM_errno;
+    }
+
+    int new_leaf;
+    if(pageAllocate(fileIndex, new_page, &new_leaf) != AME_OK){
+        pagePut(fileIndex, page, 0);
+        return AM_errno;
+    }
+
+    /* A root leaf becomes a plain leaf, since a new root will be made above it */
+    char new_type = 'l';
+    char *data = page->data, *sata = new_page->data;
+    memcpy(data, &new_type, sizeof(char));
+    memcpy(data+sizeof(char)+sizeof(int), &new_leaf, sizeof(int));
+    postingEncode(fileIndex, data, groups, half);
+
+    memcpy(sata, &new_type, sizeof(char));
+    memcpy(sata+sizeof(char)+sizeof(int), &next_leaf, sizeof(int));
+    memcpy(sata+sizeof(char)+sizeof(int)*2, &leaf, sizeof(int));
+    postingEncode(fileIndex, sata, groups+half, count-half);
+
+    /* A new key is a group of its own, so the keys after it are one group further */
+    if(position < entries && Files_array[fileIndex].keys->compare(copy+posting_offset+stride*position, value1, attrLength1) != 0){
+        scanShift(fileIndex, leaf, position, leaf, 1);
+    }
+    scanShift(fileIndex, leaf, half, new_leaf, -half);
+
+    separatorKey(fileIndex, groups[half-1].key, groups[half].key, newchildentry);
+    memcpy(newchildentry+attrLength1, &new_leaf, sizeof(int));
+
+    if(pagePut(fileIndex, page, 1) != AME_OK || pagePut(fileIndex, new_page, 1) != AME_OK){
+        return AM_errno;
+    }
+    return linkLeaf(fileIndex, next_leaf, new_leaf);
+}
+
+/**
+ * nodeHalf(int fileIndex, const char *pairs, int total, int share)
+ *  returns: the position of the key of pairs that goes up, when the total keys are shared by two internal nodes.
+ *
+ * The keys before it go to the first node and the keys after it to the second, which gets at least one of them.
+ * The position starts at share percent of the keys. Compressed keys take different space, so the position is
+ * moved away from there until both nodes fit.
+ */
+static int nodeHalf(int fileIndex, const char *pairs, int total, int share){
+    int node_entry_size = sizeof(int)+Files_array[fileIndex].attrLength1;
+    int page_size = Files_array[fileIndex].page_size;
+    int half = total*share/100;
+    if(half > total-2 && half > total/2){
+        half = (total-2 > total/2) ? total-2 : total/2;
+    }
+    for(int step = 1, prefix, width; step <= total; step++){
+        if(half >= 0 && half < total && nodeLayout(fileIndex, pairs, half, &prefix, &width) <= page_size &&
+           nodeLayout(fileIndex, pairs+node_entry_size*(half+1), total-half-1, &prefix, &width) <= page_size){
+            break;
+        }
+        half += (step%2 == 1) ? step : -step;
+    }
+    return half;
+}
+
+/**
+ * splitNode(int fileIndex, int position, char *newchildentry, int share)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Splits the full internal node N, which is held in the page of the index, after
+ * newchildentry is put right after its pointer position. With the new entry N has entries+1 keys: the first share
+ * percent of them stay, the next one goes up and the rest move to a brand new node N2, whose first pointer is the
+ * pointer of the key that goes up. That key and the number of the page of N2 are written to newchildentry, for the
+ * parent. Both nodes are released when it returns.
+ *
+ * Compressed keys take different space, so the key that goes up is moved until both nodes fit. Splitting
+ * at the new entry always fits, since each node then keeps some of the keys that were in N.
+ */
+static int splitNode(int fileIndex, int position, char *newchildentry, int share){
+    int attrLength1 = Files_array[fileIndex].attrLength1;
+    int node_entry_size = sizeof(int)+attrLength1;
+
+    struct page_ref *page = &Files_array[fileIndex].page;
+    struct page_ref *new_page = &Files_array[fileIndex].new_page;
+    char *data = page->data;
+    char *sata;
+
+    /* All the keys of N and newchildentry, in order, each one followed by its pointer */
+    char *pairs = Files_array[fileIndex].pairs;
+    int entries = nodeDecode(fileIndex, data, pairs);
+    memmove(pairs+node_entry_size*(position+1), pairs+node_entry_size*position, node_entry_size*(entries-position));
+    memcpy(pairs+node_entry_size*position, newchildentry, node_entry_size);
+
+    int total = entries+1;
+    int half = nodeHalf(fileIndex, pairs, total, share);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, node_entry_size*total);
+    int new_entries = total-half-1;
+
+    int new_node;
+    if(pageAllocate(fileIndex, new_page, &new_node) != AME_OK){
+        pagePut(fileIndex, page, 0);
+        return AM_errno;
+    }
+    sata = new_page->data;
+
+    /* A root node becomes a plain internal node, since a new root will be made above it */
+    char new_type = 'n';
+    memcpy(data, &new_type, sizeof(char));
+    nodeEncode(fileIndex, data, pairs, half);
+
+    memcpy(sata, &new_type, sizeof(char));
+    memcpy(sata+node_offset, pairs+node_entry_size*half+attrLength1, sizeof(int));
+    nodeEncode(fileIndex, sata, pairs+node_entry_size*(half+1), new_entries);
+
+    memcpy(newchildentry, pairs+node_entry_size*half, attrLength1);
+    memcpy(newchildentry+attrLength1, &new_node, sizeof(int));
+
+    if(pagePut(fileIndex, page, 1) != AME_OK || pagePut(fileIndex, new_page, 1) != AME_OK){
+        return AM_errno;
+    }
+    return AME_OK;
+}
+
+/**
+ * newRoot(int fileIndex, int left, const char *newchildentry)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Makes a new root above the splitted root left, with the <key-value, block-number> newchildentry as its only key.
+ */
+static int newRoot(int fileIndex, int left, const char *newchildentry){
+    struct page_ref *page = &Files_array[fileIndex].page;
+    char *data;
+
+    int root;
+    if(pageAllocate(fileIndex, page, &root) != AME_OK){
+        return AM_errno;
+    }
+    char type = 'r';
+    int entries = 1;
+    data = page->data;
+    memcpy(data, &type, sizeof(char));
+    memcpy(data+node_offset, &left, sizeof(int));
+    nodeEncode(fileIndex, data, newchildentry, entries);
+    if(pagePut(fileIndex, page, 1) != AME_OK){
+        return AM_errno;
+    }
+    return writeRoot(fileIndex, root);
+}
+
+/**
+ * nodeReplace(int fileIndex, int node, int position, const char *key, int *replaced)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Writes key in the place of the key position of the internal node and sets replaced to 1. A node with compressed
+ * keys may have no space for a longer key, and then it is left as it is and replaced is set to 0.
+ */
+static int nodeReplace(int fileIndex, int node, int position, const char *key, int *replaced){
+    int attrLength1 = Files_array[fileIndex].attrLength1;
+    int node_entry_size = sizeof(int)+attrLength1;
+    struct page_ref *page = &Files_array[fileIndex].page;
+    char *pairs = Files_array[fileIndex].pairs;
+    int prefix, width;
+
+    if(pageGet(fileIndex, node, page) != AME_OK){
+        return AM_errno;
+    }
+    int entries = nodeDecode(fileIndex, page->data, pairs);
+    memcpy(pairs+node_entry_size*position, key, attrLength1);
+    *replaced = (nodeLayout(fileIndex, pairs, entries, &prefix, &width) <= Files_array[fileIndex].page_size);
+    if(*replaced){
+        nodeEncode(fileIndex, page->data, pairs, entries);
+    }
+    return pagePut(fileIndex, page, *replaced);
+}
+
+/**
+ * nodeRebalance(int fileIndex, struct tree_path *path, int level, int *separator)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Fills the internal node path->blocks[level], which is less than half full, from its next sibling, or from the
+ * previous one if it is the last child of its parent. If the keys of both nodes and the key of the parent between
+ * them fit in one node, the second node is merged into the first one and freed, and separator is set to the position
+ * of the key that the parent has to lose. Otherwise the keys are shared like splitNode does, the key in the middle
+ * takes the place of the one in the parent, and separator is set to -1.
+ */
+static int nodeRebalance(int fileIndex, struct tree_path *path, int level, int *separator){
+    int attrLength1 = Files_array[fileIndex].attrLength1;
+    int node_entry_size = sizeof(int)+attrLength1;
+    int page_size = Files_array[fileIndex].page_size;
+    struct page_ref *page = &Files_array[fileIndex].page;
+    char *pairs = Files_array[fileIndex].pairs;
+    char *copy = Files_array[fileIndex].page_copy;
+    int parent = path->blocks[level-1], position = path->positions[level-1];
+    int left, right, sep, prefix, width;
+    char key[MAX_ATTR_LENGTH];
+
+    *separator = -1;
+    if(pageGet(fileIndex, parent, page) != AME_OK){
+        return AM_errno;
+    }
+    int entries = nodeDecode(fileIndex, page->data, pairs);
+    if(position < entries){
+        left = path->blocks[level];
+        right = nodeChild(fileIndex, page->data, position+1);
+        sep = position;
+    } else {
+        left = nodeChild(fileIndex, page->data, position-1);
+        right = path->blocks[level];
+        sep = position-1;
+    }
+    memcpy(key, pairs+node_entry_size*sep, attrLength1);
+    if(pagePut(fileIndex, page, 0) != AME_OK){
+        return AM_errno;
+    }
+
+    /* The keys of the left node, the key of the parent and the keys of the right node, in order, with the
+     * first pointer of the right node after the key of the parent. The pages of both nodes are kept in copy. */
+    if(pageGet(fileIndex, left, page) != AME_OK){
+        return AM_errno;
+    }
+    memcpy(copy, page->data, page_size);
+    int left_entries = nodeDecode(fileIndex, page->data, pairs);
+    if(pagePut(fileIndex, page, 0) != AME_OK || pageGet(fileIndex, right, page) != AME_OK){
+        return AM_errno;
+    }
+    memcpy(copy+page_size, page->data, page_size);
+    memcpy(pairs+node_entry_size*left_entries, key, attrLength1);
+    memcpy(pairs+node_entry_size*left_entries+attrLength1, page->data+node_offset, sizeof(int));
+    int total = left_entries+1+nodeDecode(fileIndex, page->data, pairs+node_entry_size*(left_entries+1));
+    if(pagePut(fileIndex, page, 0) != AME_OK){
+        return AM_errno;
+    }
+
+    if(nodeLayout(fileIndex, pairs, total, &prefix, &width) <= page_size){
+        if(pageGet(fileIndex, left, page) != AME_OK){
+            return AM_errno;
+        }
+        nodeEncode(fileIndex, page->data, pairs, total);
+        if(pagePut(fileIndex, page, 1) != AME_OK){
+            return AM_errno;
+        }
+        statAdd(&Files_array[fileIndex].stats.merges, 1);
+        *separator = sep;
+        return pageFree(fileIndex, right);
+    }
+
+    int half = nodeHalf(fileIndex, pairs, total, EVEN_SPLIT);
+    if(half == left_entries){
+        return AME_OK;
+    }
+    memcpy(key, pairs+node_entry_size*half, attrLength1);
+    nodeEncode(fileIndex, copy, pairs, half);
+    memcpy(copy+page_size+node_offset, pairs+node_entry_size*half+attrLength1, sizeof(int));
+    nodeEncode(fileIndex, copy+page_size, pairs+node_entry_size*(half+1), total-half-1);
+
+    int replaced;
+    if(nodeReplace(fileIndex, parent, sep, key, &replaced) != AME_OK){
+        return AM_errno;
+    }
+    for(int i = 0; replaced && i < 2; i++){
+        if(pageGet(fileIndex, (i == 0) ? left : right, page) != AME_OK){
+            return AM_errno;
+        }
+        memcpy(page->data, copy+i*page_size, page_size);
+        if(pagePut(fileIndex, page, 1) != AME_OK){
+            return AM_errno;
+        }
+    }
+    return AME_OK;
+}
+
+/**
+ * nodeRemove(int fileIndex, struct tree_path *path, int level, int position)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Removes the key position of the internal node path->blocks[level], together with the pointer after it, once the
+ * child of that pointer has been merged into the child before it. Nothing is done if position is -1. A node that is
+ * left less than half full goes through nodeRebalance, and a merge there removes a key from the parent in turn.
+ * A root that is left with a single child is freed and that child becomes the root, so the tree gets lower.
+ */
+static int nodeRemove(int fileIndex, struct tree_path *path, int level, int position){
+    int node_entry_size = sizeof(int)+Files_array[fileIndex].attrLength1;
+    struct page_ref *page = &Files_array[fileIndex].page;
+    char *pairs = Files_array[fileIndex].pairs;
+    int prefix, width;
+
+    while(position != -1){
+        int node = path->blocks[level];
+        if(pageGet(fileIndex, node, page) != AME_OK){
+            return AM_errno;
+        }
+        char *data = page->data;
+        int entries = nodeDecode(fileIndex, data, pairs);
+        memmove(pairs+node_entry_size*position, pairs+node_entry_size*(position+1), node_entry_size*(entries-position-1));
+        entries--;
+
+        if(level == 0 && entries == 0){
+            int child;
+            char type;
+            memcpy(&child, data+node_offset, sizeof(int));
+            if(pagePut(fileIndex, page, 0) != AME_OK || pageGet(fileIndex, child, page) != AME_OK){
+                return AM_errno;
+            }
+            memcpy(&type, page->data, sizeof(char));
+            type = (type == 'l') ? 'o' : 'r';
+            memcpy(page->data, &type, sizeof(char));
+            if(pagePut(fileIndex, page, 1) != AME_OK || writeRoot(fileIndex, child) != AME_OK){
+                return AM_errno;
+            }
+            return pageFree(fileIndex, node);
+        }
+
+        nodeEncode(fileIndex, data, pairs, entries);
+        int bytes = nodeLayout(fileIndex, pairs, entries, &prefix, &width);
+        if(pagePut(fileIndex, page, 1) != AME_OK){
+            return AM_errno;
+        }
+        if(level == 0 || bytes*2 >= Files_array[fileIndex].page_size){
+            return AME_OK;
+        }
+        if(nodeRebalance(fileIndex, path, level, &position) != AME_OK){
+            return AM_errno;
+        }
+        level--;
+    }
+    return AME_OK;
+}
+
+/**
+ * addStats(AM_Stats *total, const AM_Stats *stats)
+ *  returns: nothing
+ *
+ * Adds the counters of stats to total. The fields that describe the shape of a tree are not added.
+ */
+static void addStats(AM_Stats *total, const AM_Stats *stats){
+    total->inserts += stats->inserts;
+    total->appends += stats->appends;
+    total->deletes += stats->deletes;
+    total->bulk_entries += stats->bulk_entries;
+    total->lookups += stats->lookups;
+    total->scan_rows += stats->scan_rows;
+    for(int i = 0; i < AM_STATS_LEVELS; i++){
+        total->splits[i] += stats->splits[i];
+    }
+    total->root_splits += stats->root_splits;
+    total->merges += stats->merges;
+    total->freed_pages += stats->freed_pages;
+    total->reused_pages += stats->reused_pages;
+    total->blocks_pinned += stats->blocks_pinned;
+    total->cached_nodes += stats->cached_nodes;
+    total->cached_blocks += stats->cached_blocks;
+    total->prefetched_pages += stats->prefetched_pages;
+    total->comparisons += stats->comparisons;
+    total->bytes_copied += stats->bytes_copied;
+}
+
+/*
+ * The counters of an AM_Stats are the longs before its height, which the threads that read an index add to while
+ * they are read or set to zero, so they are read and written one at a time with atomic operations.
+ */
+#define STATS_COUNTERS (offsetof(AM_Stats, height)/sizeof(long))
+
+static void readCounters(AM_Stats *copy, AM_Stats *stats){
+    memset(copy, 0, sizeof(AM_Stats));
+    for(size_t i = 0; i < STATS_COUNTERS; i++){
+        ((long *)copy)[i] = __atomic_load_n(&((long *)stats)[i], __ATOMIC_RELAXED);
+    }
+}
+
+static void resetCounters(AM_Stats *stats){
+    for(size_t i = 0; i < STATS_COUNTERS; i++){
+        __atomic_store_n(&((long *)stats)[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * AM_Init()
+ *  returns: nothing
+ *
+ * This function is used to initialize the global structures that are needed for the usage
+ * of the B+ Tree, with a buffer pool of BF_BUFFER_SIZE blocks and LRU replacement.
+ */
+void AM_Init() {
+    AM_Config config = {0, 0, AM_REPLACE_LRU, 0, 0};
+
+    /* Test correct behaviour of BF_Init */
+    if (AM_InitWithConfig(&config) != AME_OK){
+        AM_PrintError("Error while initializing the file.");
+        exit(AM_errno);
+    }
+}
+
+/**
+ * AM_InitWithConfig(const AM_Config *config)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Like AM_Init, but the blocks kept in memory are config->buffer_blocks, or as many as fit in
+ * config->buffer_bytes if buffer_blocks is 0, and BF_BUFFER_SIZE if both are 0. config->replacement
+ * chooses the block that leaves a full pool. Unlike AM_Init it does not exit when it fails.
+ *
+ * The blocks that readers copy out of the pool are also kept in the cache_shards, with config->cache_blocks
+ * of them in config->cache_shards shards, as many as the pool has and AM_CACHE_SHARDS if they are 0, and none
+ * if cache_blocks is -1. The pool of libbf is one list behind bf_lock, so the shards are where the threads
+ * that search the same files at the same time find the blocks without waiting for each other.
+ *
+ * bf.h has no call for the size of the pool, which BF_Init always makes of BF_BUFFER_SIZE blocks, so the blocks
+ * that the configuration asks for beyond those are added to the cache_shards. Fewer blocks than BF_BUFFER_SIZE,
+ * or more of them with no cache_shards, are AME_CONFIG.
+ */
+int AM_InitWithConfig(const AM_Config *config) {
+    long blocks = BF_BUFFER_SIZE;
+    if(config->buffer_blocks > 0){
+        blocks = config->buffer_blocks;
+    } else if(config->buffer_bytes > 0){
+        blocks = config->buffer_bytes/BF_BLOCK_SIZE;
+    }
+    long cache_blocks = (config->cache_blocks == 0) ? BF_BUFFER_SIZE : config->cache_blocks;
+    if(cache_blocks != -1){
+        cache_blocks += blocks - BF_BUFFER_SIZE;
+    }
+    int shards = (config->cache_shards == 0) ? AM_CACHE_SHARDS : config->cache_shards;
+    if(config->buffer_blocks < 0 || config->buffer_bytes < 0 || blocks < BF_BUFFER_SIZE || blocks > 0x7fffffff
+       || (config->cache_blocks == -1 && blocks != BF_BUFFER_SIZE)
+       || (config->replacement != AM_REPLACE_LRU && config->replacement != AM_REPLACE_MRU)
+       || config->cache_blocks < -1 || config->cache_shards < 0 || (cache_blocks != -1 && shards > cache_blocks)){
+        AM_errno = AME_CONFIG;
+        return AM_errno;
+    }
+
+    ReplacementAlgorithm algorithm = (config->replacement == AM_REPLACE_MRU) ? MRU : LRU;
+    if (BF_Init(algorithm) != BF_OK){
+        AM_errno = AME_INIT;
+        return AM_errno;
+    }
+    shardsDestroy();
+    shardsInit((cache_blocks == -1) ? 0 : cache_blocks, shards);
+
+    /* Initiallize the File_array */
+    for (int i = 0; i<MAX_OPEN_FILES; i++){
+        Files_array[i].fileName = NULL;
+        Files_array[i].fileDesc = -1;
+        Files_array[i].map = NULL;
+        Files_array[i].map_size = 0;
+        Files_array[i].latch = NULL;
+        Files_array[i].attrType1 = 'l';
+        Files_array[i].attrType2 = 'l';
+        Files_array[i].attrLength1 = -1;
+        Files_array[i].attrLength2 = -1;
+        Files_array[i].page_size = -1;
+        Files_array[i].page_blocks = -1;
+        Files_array[i].compress_keys = 0;
+        Files_array[i].postings = 0;
+        Files_array[i].pairs = NULL;
+        Files_array[i].page_copy = NULL;
+        Files_array[i].groups = NULL;
+        Files_array[i].keys = NULL;
+        memset(&Files_array[i].stats, 0, sizeof(AM_Stats));
+        Files_array[i].page.block = NULL;
+        Files_array[i].page.buffer = NULL;
+        Files_array[i].new_page.block = NULL;
+        Files_array[i].new_page.buffer = NULL;
+    }
+
+    for(int i = 0; i<MAX_OPEN_SCANS; i++){
+        Scans_array[i].operator = 0;
+        Scans_array[i].value = NULL;
+        Scans_array[i].block = -1;
+        Scans_array[i].position = -1;
+        Scans_array[i].item = 0;
+        Scans_array[i].overflow = -1;
+        Scans_array[i].prefetched = -1;
+        Scans_array[i].fileDesc = -1;
+        Scans_array[i].result = NULL;
+        Scans_array[i].leaf.block = NULL;
+        Scans_array[i].leaf.buffer = NULL;
+    }
+    memset(&closed_stats, 0, sizeof(AM_Stats));
+    return AME_OK;
+}
+
+/**
+ * AM_CreateIndex(char *fileName, char attrType1, int attrLength1, char attrType2, int attrLength2)
+ *  returns: AME_OK - if it succeeds, Some other error code - if it fails
+ *
+ * This function creates a file with name fileName, that is based on a B+ Tree. The file must not
+ * already exist. The type and length of the first field(which is used for the insertion in the B+
+ * Tree as a key) are described by the second and third parameter, correnspondingly. Samewise, the
+ * type and the length of the second field are described by the fourth and fifth parameter.
+ * Every node of the B+ Tree is a single block.
+ */
+int AM_CreateIndex(char *fileName, 
+	               char attrType1, 
+	               int attrLength1, 
+	               char attrType2, 
+	               int attrLength2) {
+    return AM_CreateIndexWithPageSize(fileName, attrType1, attrLength1, attrType2, attrLength2, BF_BLOCK_SIZE);
+}
+
+/**
+ * AM_CreateIndexWithPageSize(char *fileName, char attrType1, int attrLength1, char attrType2, int attrLength2, int pageSize)
+ *  returns: AME_OK - if it succeeds, Some other error code - if it fails
+ *
+ * This function works like AM_CreateIndex, but every node of the B+ Tree is stored in a page of pageSize
+ * bytes, which is made of pageSize/BF_BLOCK_SIZE consecutive blocks. The pageSize must be a multiple of
+ * BF_BLOCK_SIZE, up to MAX_PAGE_SIZE (for example 4096, 8192 or 16384). Bigger pages hold more entries,
+ * so the B+ Tree has fewer levels and a search reads fewer nodes. The pageSize is kept in the first
+ * block of the file.
+ */
+int AM_CreateIndexWithPageSize(char *fileName,
+                               char attrType1,
+                               int attrLength1,
+                               char attrType2,
+                               int attrLength2,
+                               int pageSize) {
+    if(pageSize < BF_BLOCK_SIZE || pageSize > MAX_PAGE_SIZE || pageSize%BF_BLOCK_SIZE != 0){
+        AM_errno = AME_PAGE_SIZE;
+        return AM_errno;
+    }
+
+    if((attrType1 == 'i' && attrLength1 != sizeof(int)) || (attrType1 == 'f' && attrLength1 != sizeof(float)) || (attrType1 == 'c' && (attrLength1 < 1 || attrLength1 > MAX_ATTR_LENGTH))){
+        AM_errno = AME_TYPE;
+        return AM_errno;
+    }
+
+    if((attrType2 == 'i' && attrLength2 != sizeof(int)) || (attrType2 == 'f' && attrLength2 != sizeof(float)) || (attrType2 == 'c' && (attrLength2 < 1 || attrLength2 > MAX_ATTR_LENGTH))){
+        AM_errno = AME_TYPE;
+        return AM_errno;
+    }
+
+    if (bfCreateFile(fileName) != BF_OK){
+        AM_errno = AME_CREATE_FILE;
+        return AM_errno;
+    }
+    
+    int fileDesc;
+    if(bfOpenFile(fileName, &fileDesc) != BF_OK){
+        AM_errno = AME_OPEN_FILE;
+        return AM_errno;
+    }
+
+    BF_Block *block;
+    BF_Block_Init(&block);
+    char *data;
+    if(pinFailed(bfAllocateBlock(fileDesc, block), AME_ALLOCATE)){
+        return AM_errno;
+    }
+
+    /* Make sure that there is only one block allocated in the file. */
+    int blocks_num;
+    if(bfGetBlockCounter(fileDesc, &blocks_num) != BF_OK){
+        AM_errno = AME_COUNTER;
+        return AM_errno;
+    }
+
+    if(blocks_num != 1){
+        AM_errno = AME_BLOCKS;
+        return AM_errno;
+    }
+
+    if(pinFailed(bfGetBlock(fileDesc, 0, block), AME_GETBLOCK)){
+        return AM_errno;
+    }
+    data = BF_Block_GetData(block);
+
+    char type = 'b';
+    int zero = 0;
+    int keyFormat = KEY_FORMAT_POSTINGS | ((attrType1 == 'c') ? KEY_FORMAT_COMPRESSED : 0);
+    memcpy(data, &type, sizeof(char));
+    memcpy(data+sizeof(char), &attrType1, sizeof(char));
+    memcpy(data+sizeof(char)*2, &attrLength1, sizeof(int));
+    memcpy(data+sizeof(char)*2+sizeof(int), &attrType2, sizeof(char));
+    memcpy(data+sizeof(char)*3+sizeof(int), &attrLength2, sizeof(int));
+    memcpy(data+sizeof(char)*3+sizeof(int)*2, &zero, sizeof(int));
+    memcpy(data+sizeof(char)*3+sizeof(int)*3, &pageSize, sizeof(int));
+    memcpy(data+sizeof(char)*3+sizeof(int)*4, &keyFormat, sizeof(int));
+    memcpy(data+sizeof(char)*3+sizeof(int)*5, &zero, sizeof(int));
+
+    /*
+     * The first block presentation:
+     *
+     * ['b'(shows that the file implements a B+Tree), 
+     * attrType1,
+     * attrLength1,
+     * attrType2,
+     * attrLength2, 
+     * 0(shows which block has the root of the B+Tree),
+     * pageSize(the size of the pages that hold the nodes),
+     * keyFormat(KEY_FORMAT_COMPRESSED if the internal nodes hold compressed 'c' keys,
+     *           KEY_FORMAT_POSTINGS if the leaves are posting leaves),
+     * 0(shows the first free page, see pageFree)]
+     */
+
+    BF_Block_SetDirty(block);
+    if(bfUnpinBlock(block) != BF_OK){
+        AM_errno = AME_UNPIN;
+        return AM_errno;
+    }
+
+    BF_Block_Destroy(&block);
+    bfCloseFile(fileDesc);
+    return AME_OK;
+}
+
+/**
+ * AM_DestroyIndex(char *fileName)
+ *  returns: AME_OK - if it succeeds, Some other error code - if it fails
+ *
+ * This function destroys the file with name fileName, deleting the file from the disk.
+ * The file cannot be deleted if opens of it exist in the Files_array.
+ */
+int AM_DestroyIndex(char *fileName) {
+    pthread_mutex_lock(&table_lock);
+    for(int i = 0; i < MAX_OPEN_FILES; i++){
+        if(Files_array[i].fileName != NULL && strcmp(Files_array[i].fileName, fileName) == 0){
+            pthread_mutex_unlock(&table_lock);
+            AM_errno = AME_DESTROY;
+            return AM_errno;
+        }
+    }
+
+    int removed = remove(fileName);
+    pthread_mutex_unlock(&table_lock);
+    if(removed == 0) {
+        printf("File removed successfully.");
+        return AME_OK;
+    } else {
+        AM_errno = AME_REMOVE;
+        return AM_errno;
+    }
+
+  return AME_OK;
+}
+
+/**
+ * indexSetup(int position, const char *data)
+ *  returns: nothing
+ *
+ * Fills the position of the Files_array with the description of the B+ Tree that data, the first block of
+ * its file, holds, and allocates the memory that the operations on the index need.
+ */
+static void indexSetup(int position, const char *data){
+    int root;
+    char attrType1, attrType2;
+    int attrLength1, attrLength2, page_size, key_format, free_list;
+    memcpy(&root, data+sizeof(char)*3+sizeof(int)*2, sizeof(int));
+    memcpy(&page_size, data+sizeof(char)*3+sizeof(int)*3, sizeof(int));
+    memcpy(&key_format, data+sizeof(char)*3+sizeof(int)*4, sizeof(int));
+    memcpy(&free_list, data+sizeof(char)*3+sizeof(int)*5, sizeof(int));
+    memcpy(&attrType1, data+sizeof(char), sizeof(char));
+    memcpy(&attrLength1, data+sizeof(char)*2, sizeof(int));
+    memcpy(&attrType2, data+sizeof(char)*2+sizeof(int), sizeof(char));
+    memcpy(&attrLength2, data+sizeof(char)*3+sizeof(int), sizeof(int));
+
+    if(page_size < BF_BLOCK_SIZE || page_size > MAX_PAGE_SIZE || page_size%BF_BLOCK_SIZE != 0){
+        /* The files that were created before the page size was kept have pages of one block */
+        page_size = BF_BLOCK_SIZE;
+    }
+
+    Files_array[position].attrType1 = attrType1;
+    Files_array[position].attrType2 = attrType2;
+    Files_array[position].attrLength1 = attrLength1;
+    Files_array[position].attrLength2 = attrLength2;
+    Files_array[position].page_size = page_size;
+    Files_array[position].page_blocks = page_size/BF_BLOCK_SIZE;
+    /* The files that were created before keyFormat was kept hold the keys at full length, in plain leaves */
+    if((key_format & ~(KEY_FORMAT_COMPRESSED | KEY_FORMAT_POSTINGS)) != 0){
+        key_format = 0;
+    }
+    Files_array[position].compress_keys = (attrType1 == 'c' && (key_format & KEY_FORMAT_COMPRESSED));
+    Files_array[position].postings = (key_format & KEY_FORMAT_POSTINGS) != 0;
+    Files_array[position].pairs = malloc((size_t)(nodeMaxDecoded(position)+1)*2*(sizeof(int)+attrLength1));
+    if(Files_array[position].postings){
+        Files_array[position].page_copy = malloc((size_t)page_size*2);
+        Files_array[position].groups = malloc(sizeof(struct posting_group)*((page_size-posting_offset)/postingStride(position)+1)*2);
+    }
+    Files_array[position].keys = keyTraits(attrType1);
+    memset(&Files_array[position].stats, 0, sizeof(AM_Stats));
+    /* A file that is open at other positions too already has its root, its node_cache, its free pages and its
+     * rightmost leaf in the latch, where every position changes them. AM_Compact opens the file again as the only
+     * user of its latch. */
+    if(Files_array[position].latch->users == 1){
+        struct index_latch *latch = Files_array[position].latch;
+        latch->rootBlock = root;
+        latch->free_list = (free_list > 0) ? free_list : 0;
+        latch->append_leaf = -1;
+        latch->leaf_level = -1;
+        free(latch->append_key);
+        latch->append_key = malloc(attrLength1);
+        cacheDestroy(position);
+        cacheInit(position);
+    }
+    pageInit(&Files_array[position].page, page_size, 0);
+    pageInit(&Files_array[position].new_page, page_size, 0);
+}
+
+/**
+ * openIndex(int position, char *fileName)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Opens the file with name fileName at the empty position of the Files_array, reading the
+ * description of the B+ Tree from the first block of the file, and gives the position the latch
+ * of the file, unless it still has it, as when AM_Compact opens the file again.
+ */
+static int openIndex(int position, char *fileName){
+    Files_array[position].fileName = (char*)malloc(sizeof(char)*(strlen(fileName)+1));
+    strcpy(Files_array[position].fileName, fileName);
+
+    int fileDesc;
+    if(bfOpenFile(fileName, &fileDesc) != BF_OK){
+        free(Files_array[position].fileName);
+        Files_array[position].fileName = NULL;
+        AM_errno = AME_OPEN_FILE;
+        return AM_errno;
+    }
+    Files_array[position].fileDesc = fileDesc;
+
+    BF_Block *block;
+    BF_Block_Init(&block);
+    char *data;
+    
+    if(pinFailed(bfGetBlock(fileDesc, 0, block), AME_GETBLOCK)){
+        return AM_errno;
+    }
+    
+    data = BF_Block_GetData(block);
+    if(Files_array[position].latch == NULL){
+        latchAttach(position);
+    }
+    indexSetup(position, data);
+    if(bfUnpinBlock(block) != BF_OK){
+        AM_errno = AME_UNPIN;
+        return AM_errno;
+    }
+    BF_Block_Destroy(&block);
+    return AME_OK;
+}
+
+/**
+ * releaseIndex(int fileIndex)
+ *  returns: nothing
+ *
+ * Empties the position fileIndex of the Files_array and frees the memory of the index, without
+ * closing its file.
+ */
+static void releaseIndex(int fileIndex){
+    free(Files_array[fileIndex].fileName);
+    Files_array[fileIndex].fileName = NULL;
+    Files_array[fileIndex].fileDesc = -1;
+    Files_array[fileIndex].map = NULL;
+    Files_array[fileIndex].map_size = 0;
+    Files_array[fileIndex].attrType1 = 'l';
+    Files_array[fileIndex].attrType2 = 'l';
+    Files_array[fileIndex].attrLength1 = -1;
+    Files_array[fileIndex].attrLength2 = -1;
+    Files_array[fileIndex].page_size = -1;
+    Files_array[fileIndex].page_blocks = -1;
+    Files_array[fileIndex].compress_keys = 0;
+    Files_array[fileIndex].postings = 0;
+    free(Files_array[fileIndex].pairs);
+    free(Files_array[fileIndex].page_copy);
+    free(Files_array[fileIndex].groups);
+    Files_array[fileIndex].pairs = NULL;
+    Files_array[fileIndex].page_copy = NULL;
+    Files_array[fileIndex].groups = NULL;
+    Files_array[fileIndex].keys = NULL;
+    pageDestroy(&Files_array[fileIndex].page);
+    pageDestroy(&Files_array[fileIndex].new_page);
+}
+
+/**
+ * AN_OpenIndex(char *fileName)
+ *  returns: integer - Position in the Files_array that the file is opened
+ *           Some error code - if it fails.
+ *
+ * This function opens the file with name fileName. If the file is normally
+ * opened, the function returns a small, non-negative integer, which is used
+ * to recognize the file. In any other case, it returns an error code.
+ *
+ * There is a Files_array keeped in the memory for all the opened files. The
+ * integer that is returned by the AM_OpenIndex is the position of the table
+ * that corrensponds to the file that was just opened. The same file may be
+ * opened many times and for each time it occupies a different position in the
+ * table.
+ */
+int AM_OpenIndex (char *fileName) {
+    pthread_mutex_lock(&table_lock);
+    for(int i = 0; i < MAX_OPEN_FILES; i++){
+        if(Files_array[i].fileDesc == -1){
+            /* An empty position in the Files_array has been found */
+            if(openIndex(i, fileName) != AME_OK){
+                pthread_mutex_unlock(&table_lock);
+                return AM_errno;
+            }
+            pthread_mutex_unlock(&table_lock);
+            return i;
+        }
+    }
+
+    pthread_mutex_unlock(&table_lock);
+    AM_errno = AME_OPENINDEX;
+    return AM_errno;
+}
+
+/**
+ * mapIndex(int position, char *fileName)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Maps the whole file with name fileName to memory, for AM_OpenIndexReadOnly, and opens it at the empty
+ * position of the Files_array, reading the description of the B+ Tree from the first block of the map.
+ */
+static int mapIndex(int position, char *fileName){
+    int fd = open(fileName, O_RDONLY);
+    if(fd == -1){
+        AM_errno = AME_OPEN_FILE;
+        return AM_errno;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < BF_BLOCK_SIZE || st.st_size%BF_BLOCK_SIZE != 0){
+        close(fd);
+        AM_errno = AME_BLOCKS;
+        return AM_errno;
+    }
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED || map[0] != 'b'){
+        if(map != MAP_FAILED){
+            munmap(map, st.st_size);
+        }
+        close(fd);
+        AM_errno = AME_OPEN_FILE;
+        return AM_errno;
+    }
+
+    Files_array[position].fileName = (char*)malloc(sizeof(char)*(strlen(fileName)+1));
+    strcpy(Files_array[position].fileName, fileName);
+    Files_array[position].fileDesc = fd;
+    Files_array[position].map = map;
+    Files_array[position].map_size = st.st_size;
+    latchAttach(position);
+    indexSetup(position, map);
+    return AME_OK;
+}
+
+/**
+ * AM_OpenIndexReadOnly(char *fileName)
+ *  returns: integer - Position in the Files_array that the file is opened
+ *           Some error code - if it fails.
+ *
+ * This function opens the file with name fileName like AM_OpenIndex, but only for searches and
+ * scans. The whole file is mapped to memory with mmap, and the nodes are read where they are in
+ * the map, without BF_GetBlock, BF_UnpinBlock or any copy of them, so the pages are kept by the
+ * page cache of the system and the size of the buffer pool does not limit the scans. Inserts,
+ * deletes, AM_BulkLoad and AM_Compact on the index return AME_READ_ONLY.
+ *
+ * The map shows the file as it is on the disk, so an index that is opened for writing as well
+ * should be closed first, for the BF level to write its blocks.
+ */
+int AM_OpenIndexReadOnly(char *fileName) {
+    pthread_mutex_lock(&table_lock);
+    for(int i = 0; i < MAX_OPEN_FILES; i++){
+        if(Files_array[i].fileDesc == -1){
+            if(mapIndex(i, fileName) != AME_OK){
+                pthread_mutex_unlock(&table_lock);
+                return AM_errno;
+            }
+            pthread_mutex_unlock(&table_lock);
+            return i;
+        }
+    }
+
+    pthread_mutex_unlock(&table_lock);
+    AM_errno = AME_OPENINDEX;
+    return AM_errno;
+}
+
+/**
+ * AM_CloseIndex(int fileDesc)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * This function closes the file that is defined by its parameter. It also
+ * removes the entry that corrensponds to that file from the Files_array. In
+ * order for the file that is defined by the parameter fileDesc to be closed
+ * successfully, there must not be opened scans of it.
+ */
+int AM_CloseIndex (int fileDesc) {
+    pthread_mutex_lock(&table_lock);
+    if(fileDesc < 0 || fileDesc >= MAX_OPEN_FILES || Files_array[fileDesc].fileDesc == -1){
+        pthread_mutex_unlock(&table_lock);
+        AM_errno = AME_CLOSE_NOT_EXIST;
+        return AM_errno;
+    }
+
+    for(int i = 0; i < MAX_OPEN_SCANS; i++){
+        if(Scans_array[i].value != NULL && Scans_array[i].fileDesc == fileDesc){
+            pthread_mutex_unlock(&table_lock);
+            AM_errno = AME_OPEN_SCAN;
+            return AM_errno;
+        }
+    }
+
+    /* The fileDesc is the position of the opened file in the Files_array */
+    int file_id = Files_array[fileDesc].fileDesc;
+    char *map = Files_array[fileDesc].map;
+    size_t map_size = Files_array[fileDesc].map_size;
+    addStats(&closed_stats, &Files_array[fileDesc].stats);
+    memset(&Files_array[fileDesc].stats, 0, sizeof(AM_Stats));
+    latchDetach(fileDesc);
+    releaseIndex(fileDesc);
+    pthread_mutex_unlock(&table_lock);
+
+    if(map != NULL){
+        if(munmap(map, map_size) != 0 || close(file_id) != 0){
+            AM_errno = AME_CLOSE;
+            return AM_errno;
+        }
+        return AME_OK;
+    }
+
+    if(bfCloseFile(file_id) != BF_OK){
+        AM_errno = AME_CLOSE;
+        return AM_errno;
+    }
+
+    return AME_OK;
+}
+
+/**
+ * insertLatched(int fileDesc, void *value1, void *value2)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * The insert of AM_InsertEntry, with the latch of the index held exclusively.
+ */
+static int insertLatched(int fileDesc, void *value1, void *value2) {
+    /* The nodes inside the file can be categorized in 4 ways, which will be represented by a (char) inside the file. 
+     *  ['o'] this means that the node is a root node and a leaf.
+     *  ['r'] this means that the node is a root node but not a leaf.
+     *  ['n'] this means that the node is an internal tree node.
+     *  ['l'] this means that the node is a leaf node.
+     *
+     * The fileDesc value is the position of the opened file in the array. So it is like an index. */
+    int attrLength1 = Files_array[fileDesc].attrLength1, attrLength2 = Files_array[fileDesc].attrLength2;
+    int file_id = Files_array[fileDesc].fileDesc;
+
+    struct page_ref *page = &Files_array[fileDesc].page;
+    char *data;
+
+    if(Files_array[fileDesc].map != NULL){
+        AM_errno = AME_READ_ONLY;
+        return AM_errno;
+    }
+    statAdd(&Files_array[fileDesc].stats.inserts, 1);
+    int blocks_number;
+    if(bfGetBlockCounter(file_id, &blocks_number) != BF_OK){
+        AM_errno = AME_BLOCKS;
+        return AM_errno;
+    }
+    if(blocks_number == 1){
+        /*  In this case, this is the first entry inserted in the file.
+         *  We need to allocate and initiallize a new page, which will be a root as well as a leaf node.
+         *  Next we insert the first entry.
+         */
+        int leaf;
+        if(pageAllocate(fileDesc, page, &leaf) != AME_OK){
+            return AM_errno;
+        }
+
+        char type = 'o';
+        int entries = 1;
+        int next_leaf = -1;
+        int prev_leaf = -1;
+
+        /* Each leaf block holds the following information in the same order:
+         * [ type - the type that shows if the block is a leaf
+         *   entries - the number of entries that the block holds
+         *   next_leaf - the next leaf block that holds bigger values
+         *   prev_leaf - the previous leaf block that holds lower values
+         *
+         *   keys[max_entries] - the first fields of the entries, one after the other in ascending order.
+         *   values[max_entries] - the second fields of the entries, in the same order as the keys.
+         * ]
+         * Keeping the keys together lets a leaf be binary searched and scanned without jumping around the block.
+         */
+        int max_entries = leafMaxEntries(fileDesc);
+
+        data = page->data;
+
+        memcpy(data, &type, sizeof(char));
+        memcpy(data+sizeof(char), &entries, sizeof(int));
+        memcpy(data+sizeof(char)+sizeof(int), &next_leaf, sizeof(int));
+        memcpy(data+sizeof(char)+sizeof(int)*2, &prev_leaf, sizeof(int));
+
+        if(Files_array[fileDesc].postings){
+            /* A posting leaf keeps the number of its values after prev_leaf, see postingInsert */
+            int full, zero = 0;
+            memcpy(data+sizeof(char), &zero, sizeof(int));
+            memcpy(data+leaf_offset, &zero, sizeof(int));
+            postingInsert(fileDesc, leaf, data, value1, value2, &full);
+        } else {
+            memcpy(data+leaf_offset, value1, attrLength1);
+            memcpy(data+leaf_offset+max_entries*attrLength1, value2, attrLength2);
+        }
+
+        if(pagePut(fileDesc, page, 1) != AME_OK){
+            return AM_errno;
+        }
+
+        /* The new page is right after the first block of the file */
+        if(writeRoot(fileDesc, leaf) != AME_OK){
+            return AM_errno;
+        }
+    } else {
+        /* If the B+Tree has already been built, then insert the entry through insertEntry */
+        int result = insertEntry(fileDesc, value1, value2);
+        if(result != AME_OK){
+            /* A full buffer pool is told apart, since the same insert succeeds once other blocks are unpinned */
+            AM_errno = (result == AME_FULL_MEMORY) ? AME_FULL_MEMORY : AME_INSERT_ERROR;
+            return AM_errno;
+        }
+    }
+    return AME_OK;
+}
+
+/**
+ * rightmostKey(int fileIndex, const char *data)
+ *  returns: the highest key of the leaf data, NULL - if data is not the rightmost leaf or it is empty.
+ */
+static const char *rightmostKey(int fileIndex, const char *data){
+    char type;
+    int entries, next_leaf;
+    memcpy(&type, data, sizeof(char));
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+    memcpy(&next_leaf, data+sizeof(char)+sizeof(int), sizeof(int));
+    if((type != 'o' && type != 'l') || next_leaf != -1 || entries == 0){
+        return NULL;
+    }
+    if(Files_array[fileIndex].postings){
+        return data+posting_offset+postingStride(fileIndex)*(entries-1);
+    }
+    return data+leaf_offset+(entries-1)*Files_array[fileIndex].attrLength1;
+}
+
+/**
+ * appendAfter(int fileIndex, const char *last, const void *value1)
+ *  returns: 1 - if value1 goes after last, the highest key of the rightmost leaf, 0 - if it does not.
+ */
+static int appendAfter(int fileIndex, const char *last, const void *value1){
+    statAdd(&Files_array[fileIndex].stats.comparisons, 1);
+    int result = Files_array[fileIndex].keys->compare(value1, last, Files_array[fileIndex].attrLength1);
+    return result > 0 || (result == 0 && Files_array[fileIndex].postings);
+}
+
+/**
+ * appendKey(int fileIndex, int leaf, const char *data, const void *value1)
+ *  returns: 1 - if data is the rightmost leaf and value1 goes after all of its keys, 0 - if it does not.
+ *
+ * The rightmost leaf is the only one whose next_leaf is -1, so a page that is still that leaf is known as soon as it
+ * is read, even after deletes freed it. It is kept in append_leaf of the latch, together with its highest key, for
+ * the inserts through every position of the file. A key that is equal to the highest one goes after it only in a
+ * posting leaf, since a plain leaf may have more of its duplicates in the leaves before it.
+ */
+static int appendKey(int fileIndex, int leaf, const char *data, const void *value1){
+    const char *last = rightmostKey(fileIndex, data);
+    if(last == NULL){
+        return 0;
+    }
+    Files_array[fileIndex].latch->append_leaf = leaf;
+    memcpy(Files_array[fileIndex].latch->append_key, last, Files_array[fileIndex].attrLength1);
+    return appendAfter(fileIndex, last, value1);
+}
+
+/**
+ * insertShared(int fileDesc, void *value1, void *value2, int *done)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * The insert of AM_InsertEntry, with the latch of the index held shared, for an entry that fits in its leaf.
+ * A key that goes after the highest key of append_leaf goes to that leaf, like insertEntry does, and any other
+ * key goes down the tree through a page of the thread, like a search does, down to leaf_level without reading
+ * the leaf. The latch of the leaf is taken exclusively before the leaf is read, and if the entry fits it is put
+ * there and done is set to 1. Otherwise nothing is written and done stays 0, so that the insert is done again
+ * with the latch of the index held exclusively, since it needs a new page. The tree, append_leaf, append_key
+ * and leaf_level only change while that latch is held exclusively, so the leaf that was found is still the
+ * one that the entry goes to.
+ */
+static int insertShared(int fileDesc, void *value1, void *value2, int *done){
+    int attrLength1 = Files_array[fileDesc].attrLength1;
+    *done = 0;
+    if(Files_array[fileDesc].map != NULL){
+        return AME_OK;
+    }
+    int blocks_number;
+    if(blockCounter(fileDesc, &blocks_number) != AME_OK || blocks_number == 1){
+        return AME_OK;
+    }
+
+    int leaf = Files_array[fileDesc].latch->append_leaf;
+    int append = 0;
+    if(leaf != -1){
+        statAdd(&Files_array[fileDesc].stats.comparisons, 1);
+        append = (Files_array[fileDesc].keys->compare(value1, Files_array[fileDesc].latch->append_key, attrLength1) >= 0);
+    }
+    if(!append){
+        struct page_ref node;
+        pageInit(&node, Files_array[fileDesc].page_size, 1);
+        int result = descend(fileDesc, value1, Files_array[fileDesc].latch->rootBlock, &node, NULL, Files_array[fileDesc].latch->leaf_level, &leaf);
+        pageDestroy(&node);
+        if(result != AME_OK){
+            return AME_OK;
+        }
+    }
+
+    /* With the latch of the leaf held exclusively no other thread pins it, so a leaf of a single block is written in place */
+    struct page_ref page;
+    int result = AME_OK;
+    pageInit(&page, Files_array[fileDesc].page_size, 0);
+    pthread_rwlock_t *latch = leafLatch(fileDesc, leaf);
+    pthread_rwlock_wrlock(latch);
+    if(pageGetHeld(fileDesc, leaf, &page) == AME_OK){
+        char *data = page.data;
+        const char *last = append ? rightmostKey(fileDesc, data) : NULL;
+        char type;
+        int entries, full = 1;
+        memcpy(&type, data, sizeof(char));
+        memcpy(&entries, data+sizeof(char), sizeof(int));
+        if(type != 'o' && type != 'l'){
+            /* The tree has grown since leaf_level was found */
+        } else if(append && (last == NULL || !appendAfter(fileDesc, last, value1))){
+            /* append_leaf is not the leaf of the key any more */
+        } else if(Files_array[fileDesc].postings){
+            if(postingLocal(fileDesc, data, value1)){
+                result = postingInsert(fileDesc, leaf, data, value1, value2, &full);
+            }
+        } else if(entries < leafMaxEntries(fileDesc)){
+            leafInsert(fileDesc, leaf, data, value1, value2);
+            full = 0;
+        }
+        *done = (result == AME_OK && !full);
+        if(*done){
+            statAdd(&Files_array[fileDesc].stats.inserts, 1);
+            statAdd(&Files_array[fileDesc].stats.appends, append);
+        }
+        if(pagePut(fileDesc, &page, *done) != AME_OK && result == AME_OK){
+            result = AM_errno;
+        }
+    }
+    pthread_rwlock_unlock(latch);
+    pageDestroy(&page);
+    return result;
+}
+
+/**
+ * AM_InsertEntry(int fileDesc, void* value1, void* value2)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * This function inserts the pair(value1, value2) at the file that is pointed by the
  * parameter fileDesc. The parameter value1 points to the value of the key-field that
  * is inserted to the file and the value2 represents the other field of the record.
+ *
+ * An entry that fits in its leaf is put there with the latch of the index held shared (see insertShared), so
+ * inserts to different leaves go on together. Only an insert that splits a leaf, or that writes other pages,
+ * holds the latch exclusively and waits for the rest.
  */
 int AM_InsertEntry(int fileDesc, void *value1, void *value2) {
-    /* The nodes inside the file can be categorized in 4 ways, which will be represented by a (char) inside the file. 
-     *  ['o'] this means that the node is a root node and a leaf.
-     *  ['r'] this means that the node is a root node but not a leaf.
-     *  ['n'] this means that the node is an internal tree node.
-     *  ['l'] this means that the node is a leaf node.
-     *
-     * The fileDesc value is the position of the opened file in the array. So it is like an index. */
-    int root = Files_array[fileDesc].rootBlock;
-    int attrLength1 = Files_array[fileDesc].attrLength1, attrLength2 = Files_array[fileDesc].attrLength2;
-    char attrType1 = Files_array[fileDesc].attrType1, attrType2 = Files_array[fileDesc].attrType2;
-    int file_id = Files_array[fileDesc].fileDesc;
+    if(fileDesc < 0 || fileDesc >= MAX_OPEN_FILES || Files_array[fileDesc].fileDesc == -1){
+        AM_errno = AME_NOTOPEN;
+        return AM_errno;
+    }
 
-    BF_Block *block;
-    BF_Block_Init(&block);
+    int done;
+    latchShared(fileDesc);
+    int result = insertShared(fileDesc, value1, value2, &done);
+    latchRelease(fileDesc);
+    if(done || result != AME_OK){
+        return result;
+    }
+
+    latchExclusive(fileDesc);
+    result = insertLatched(fileDesc, value1, value2);
+    latchRelease(fileDesc);
+    return result;
+}
+
+/**
+ * insertEntry(int fileDesc, void *value1, void *value2)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ *  This is the insert entry of a B+ Tree that already has a root. It goes down from the root to the leaf that
+ *  the entry needs to be placed, keeping the internal nodes it passes and the pointer it followed in each of
+ *  them in a tree_path. Then it inserts the entry if there is space, or it splits the leaf into two leafs and
+ *  the <key-value, block-number> of the new leaf goes to the parent, which is found in the tree_path and may
+ *  need to be splitted as well. If the root is splitted, the tree gets a new root.
+ *
+ *  A key that is not lower than the highest key of the rightmost leaf (see appendKey) goes straight to that leaf,
+ *  without going down the tree, which is needed only if the leaf has to be splitted. Such a split, and the splits
+ *  of the rightmost nodes above it, keep APPEND_SPLIT percent of the entries in the old node, so sequential keys
+ *  leave the nodes almost full instead of half-empty.
+ *
+ *  fileDesc - holds the index of the Files_array in which the file that the insert will take place is.
+ */
+int insertEntry(int fileDesc, void *value1, void *value2){
+    int attrLength1 = Files_array[fileDesc].attrLength1;
+    int max_entries = leafMaxEntries(fileDesc);
+
+    struct page_ref *page = &Files_array[fileDesc].page;
     char *data;
+    struct tree_path path;
+    int leaf = Files_array[fileDesc].latch->append_leaf;
+    int append = 0;
+
+    /* The rightmost leaf is read only if the key is not lower than the highest key it had */
+    path.height = -1;
+    if(leaf != -1){
+        statAdd(&Files_array[fileDesc].stats.comparisons, 1);
+        if(Files_array[fileDesc].keys->compare(value1, Files_array[fileDesc].latch->append_key, attrLength1) >= 0 &&
+           pageGet(fileDesc, leaf, page) == AME_OK){
+            append = appendKey(fileDesc, leaf, page->data, value1);
+            if(!append){
+                pagePut(fileDesc, page, 0);
+            }
+        }
+    }
+    if(append){
+        statAdd(&Files_array[fileDesc].stats.appends, 1);
+    } else {
+        if(descend(fileDesc, value1, Files_array[fileDesc].latch->rootBlock, page, &path, -1, &leaf) != AME_OK){
+            return AM_errno;
+        }
+        append = appendKey(fileDesc, leaf, page->data, value1);
+    }
+    data = page->data;
+
+    /* newchildentry holds the <key-value, page-number> that has to be inserted to the parent,
+     * in the same layout as a key and the pointer after it in an internal node. */
+    char newchildentry[MAX_ATTR_LENGTH+sizeof(int)];
+    int entries;
+    if(Files_array[fileDesc].postings){
+        int full;
+        if(postingInsert(fileDesc, leaf, data, value1, value2, &full) != AME_OK){
+            pagePut(fileDesc, page, 0);
+            return AM_errno;
+        }
+        if(!full){
+            return pagePut(fileDesc, page, 1);
+        }
+    } else {
+        memcpy(&entries, data+sizeof(char), sizeof(int));
+        if(entries < max_entries){
+            /* L has space, put entry on it and return */
+            leafInsert(fileDesc, leaf, data, value1, value2);
+            return pagePut(fileDesc, page, 1);
+        }
+    }
+
+    if(path.height == -1){
+        /* The leaf was found without going down the tree, so the path to it is found now, for the split */
+        if(pagePut(fileDesc, page, 0) != AME_OK || descend(fileDesc, value1, Files_array[fileDesc].latch->rootBlock, page, &path, -1, &leaf) != AME_OK){
+            return AM_errno;
+        }
+    }
+    int share = append ? APPEND_SPLIT : EVEN_SPLIT;
+    if(Files_array[fileDesc].postings){
+        if(postingSplit(fileDesc, leaf, value1, value2, newchildentry, share) != AME_OK){
+            return AM_errno;
+        }
+    } else if(splitLeaf(fileDesc, leaf, value1, value2, newchildentry, share) != AME_OK){
+        return AM_errno;
+    }
+    statAdd(&Files_array[fileDesc].stats.splits[0], 1);
+    if(append){
+        /* value1 went to the new leaf, which is now the rightmost one */
+        memcpy(&Files_array[fileDesc].latch->append_leaf, newchildentry+attrLength1, sizeof(int));
+        memcpy(Files_array[fileDesc].latch->append_key, value1, attrLength1);
+    }
+
+    for(int level = path.height-1; level >= 0; level--){
+        if(pageGet(fileDesc, path.blocks[level], page) != AME_OK){
+            return AM_errno;
+        }
+        data = page->data;
+
+        if(nodeInsert(fileDesc, data, path.positions[level], newchildentry)){
+            return pagePut(fileDesc, page, 1);
+        }
+        if(splitNode(fileDesc, path.positions[level], newchildentry, share) != AME_OK){
+            return AM_errno;
+        }
+        int height = path.height-level < AM_STATS_LEVELS ? path.height-level : AM_STATS_LEVELS-1;
+        statAdd(&Files_array[fileDesc].stats.splits[height], 1);
+    }
+
+    /* The root was splitted, so a new root is made above it */
+    statAdd(&Files_array[fileDesc].stats.root_splits, 1);
+    return newRoot(fileDesc, Files_array[fileDesc].latch->rootBlock, newchildentry);
+}
+
+/**
+ * leafRebalance(int fileIndex, struct tree_path *path, int leaf, int *separator)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Fills the posting leaf, which is less than half full, from its next_leaf, or from its prev_leaf if it is the last
+ * child of its parent, so that both leaves have the same parent. If the groups of both leaves fit in one leaf, the
+ * second leaf is merged into the first one and freed, and separator is set to the position of the key that the parent
+ * has to lose. Otherwise the groups are shared like postingSplit does, their separatorKey takes the place of the one
+ * in the parent, and separator is set to -1.
+ */
+static int leafRebalance(int fileIndex, struct tree_path *path, int leaf, int *separator){
+    int page_size = Files_array[fileIndex].page_size;
+    int stride = postingStride(fileIndex);
+    struct page_ref *page = &Files_array[fileIndex].page;
+    char *copy = Files_array[fileIndex].page_copy;
+    struct posting_group *groups = Files_array[fileIndex].groups;
+    int parent = path->blocks[path->height-1], position = path->positions[path->height-1];
+    int left, right, sep, entries;
+
+    *separator = -1;
+    if(pageGet(fileIndex, parent, page) != AME_OK){
+        return AM_errno;
+    }
+    memcpy(&entries, page->data+sizeof(char), sizeof(int));
+    if(position < entries){
+        left = leaf;
+        right = nodeChild(fileIndex, page->data, position+1);
+        sep = position;
+    } else {
+        left = nodeChild(fileIndex, page->data, position-1);
+        right = leaf;
+        sep = position-1;
+    }
+    if(pagePut(fileIndex, page, 0) != AME_OK){
+        return AM_errno;
+    }
+
+    /* The groups point to copies of the two leaves, since both of them are written again */
+    int count = 0, left_count = 0, total = 0;
+    for(int i = 0; i < 2; i++){
+        char *leaf_copy = copy+i*page_size;
+        if(pageGet(fileIndex, (i == 0) ? left : right, page) != AME_OK){
+            return AM_errno;
+        }
+        memcpy(leaf_copy, page->data, page_size);
+        if(pagePut(fileIndex, page, 0) != AME_OK){
+            return AM_errno;
+        }
+        memcpy(&entries, leaf_copy+sizeof(char), sizeof(int));
+        for(int j = 0; j < entries; j++){
+            struct posting_group *group = &groups[count++];
+            int start, end;
+            group->overflow = postingRun(fileIndex, leaf_copy, j, &start, &end);
+            group->key = leaf_copy+posting_offset+stride*j;
+            group->values = postingSlot(fileIndex, leaf_copy, end-1);
+            group->slots = end-start;
+            group->extra = NULL;
+            total += postingBytes(fileIndex, group);
+        }
+        left_count = (i == 0) ? count : left_count;
+    }
+    int next_leaf;
+    memcpy(&next_leaf, copy+page_size+sizeof(char)+sizeof(int), sizeof(int));
+
+    if(total <= page_size-posting_offset){
+        if(pageGet(fileIndex, left, page) != AME_OK){
+            return AM_errno;
+        }
+        memcpy(page->data+sizeof(char)+sizeof(int), &next_leaf, sizeof(int));
+        postingEncode(fileIndex, page->data, groups, count);
+        if(pagePut(fileIndex, page, 1) != AME_OK || linkLeaf(fileIndex, next_leaf, left) != AME_OK){
+            return AM_errno;
+        }
+        statAdd(&Files_array[fileIndex].stats.merges, 1);
+        *separator = sep;
+        return pageFree(fileIndex, right);
+    }
+
+    int half = postingHalf(fileIndex, groups, count, EVEN_SPLIT);
+    if(half == -1 || half == left_count){
+        return AME_OK;
+    }
+    char key[MAX_ATTR_LENGTH];
+    int replaced;
+    separatorKey(fileIndex, groups[half-1].key, groups[half].key, key);
+    if(nodeReplace(fileIndex, parent, sep, key, &replaced) != AME_OK){
+        return AM_errno;
+    }
+    for(int i = 0; replaced && i < 2; i++){
+        if(pageGet(fileIndex, (i == 0) ? left : right, page) != AME_OK){
+            return AM_errno;
+        }
+        postingEncode(fileIndex, page->data, (i == 0) ? groups : groups+half, (i == 0) ? half : count-half);
+        if(pagePut(fileIndex, page, 1) != AME_OK){
+            return AM_errno;
+        }
+    }
+    return AME_OK;
+}
+
+/**
+ * deleteLatched(int fileDesc, void *value1, void *value2)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * The delete of AM_DeleteEntry, with the latch of the index held exclusively.
+ */
+static int deleteLatched(int fileDesc, void *value1, void *value2){
+    if(Files_array[fileDesc].map != NULL){
+        AM_errno = AME_READ_ONLY;
+        return AM_errno;
+    }
+    if(!Files_array[fileDesc].postings){
+        AM_errno = AME_KEY_FORMAT;
+        return AM_errno;
+    }
+    /* A merge may free the leaf of a scan that was opened at another position of the same file as well */
+    pthread_mutex_lock(&table_lock);
+    for(int i = 0; i < MAX_OPEN_SCANS; i++){
+        if(Scans_array[i].value != NULL && Files_array[Scans_array[i].fileDesc].latch == Files_array[fileDesc].latch){
+            pthread_mutex_unlock(&table_lock);
+            AM_errno = AME_OPEN_SCAN;
+            return AM_errno;
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+
+    int space = Files_array[fileDesc].page_size-posting_offset;
+    struct page_ref *page = &Files_array[fileDesc].page;
+    struct tree_path path;
+    int leaf, found;
 
     int blocks_number;
-    if(BF_GetBlockCounter(file_id, &blocks_number) != BF_OK){
+    if(bfGetBlockCounter(Files_array[fileDesc].fileDesc, &blocks_number) != BF_OK){
         AM_errno = AME_BLOCKS;
         return AM_errno;
     }
     if(blocks_number == 1){
-        /*  In this case, this is the first entry inserted in the file.
-         *  We need to allocate and initiallize a new block, which will be a root as well as a leaf node.
-         *  Next we insert the first entry.
-         */
-        if(BF_AllocateBlock(file_id, block) != BF_OK){
-            AM_errno = AME_ALLOCATE;
+        AM_errno = AME_NOT_FOUND;
+        return AM_errno;
+    }
+
+    if(descend(fileDesc, value1, Files_array[fileDesc].latch->rootBlock, page, &path, -1, &leaf) != AME_OK){
+        return AM_errno;
+    }
+    if(postingRemove(fileDesc, page->data, value1, value2, &found) != AME_OK){
+        pagePut(fileDesc, page, 0);
+        return AM_errno;
+    }
+    if(!found){
+        pagePut(fileDesc, page, 0);
+        AM_errno = AME_NOT_FOUND;
+        return AM_errno;
+    }
+    statAdd(&Files_array[fileDesc].stats.deletes, 1);
+
+    int underfull = (space-postingFree(fileDesc, page->data))*2 < space;
+    if(pagePut(fileDesc, page, 1) != AME_OK){
+        return AM_errno;
+    }
+    if(!underfull || path.height == 0){
+        return AME_OK;
+    }
+
+    int separator;
+    if(leafRebalance(fileDesc, &path, leaf, &separator) != AME_OK){
+        return AM_errno;
+    }
+    return nodeRemove(fileDesc, &path, path.height-1, separator);
+}
+
+/**
+ * AM_DeleteEntry(int fileDesc, void *value1, void *value2)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * This function removes the pair(value1, value2) from the file that is pointed by the parameter fileDesc,
+ * once if the file holds it more than once. It goes down to the leaf of value1 like insertEntry and removes
+ * the pair from it. A leaf that is left less than half full is merged with a sibling or takes keys from it,
+ * and the merges go up the tree through nodeRemove, so the tree stays compact and may get lower. The pages
+ * that no node uses any more are put in the list of free pages.
+ *
+ * Only files with posting leaves support deletes. A scan may be reading a leaf that is merged, so there
+ * must not be opened scans of the file.
+ */
+int AM_DeleteEntry(int fileDesc, void *value1, void *value2){
+    if(fileDesc < 0 || fileDesc >= MAX_OPEN_FILES || Files_array[fileDesc].fileDesc == -1){
+        AM_errno = AME_NOTOPEN;
+        return AM_errno;
+    }
+
+    latchExclusive(fileDesc);
+    int result = deleteLatched(fileDesc, value1, value2);
+    latchRelease(fileDesc);
+    return result;
+}
+
+/*
+ * A bulk_loader writes a B+ Tree bottom-up from entries that arrive in ascending order.
+ * The leaves are allocated one after the other at the end of the file, so the next_leaf of every
+ * leaf is the page right after it. Only the leaf that is being filled is held at any moment.
+ * The number of entries is known beforehand, so they are spread evenly over the leaves and no
+ * leaf ends up almost empty.
+ */
+struct bulk_loader{
+    int fileIndex;
+    int leaves;         /* number of leaves that will be written */
+    int first_leaf;     /* page number of the first leaf */
+    int leaf;           /* the leaf that is being filled */
+    int leaf_entries;   /* entries that the current leaf will hold */
+    int entries;        /* entries already written to the current leaf */
+    int base, extra;    /* every leaf holds base entries and the first extra leaves hold one more */
+    int capacity;       /* the leaves that children and keys have space for */
+    int used;           /* bytes of the current posting leaf that are used */
+    float fillFactor;
+    struct page_ref *page;
+    int *children;      /* page number of every leaf, and later of every node of the last level built */
+    char *keys;         /* the separatorKey before each of the children */
+    char last_key[MAX_ATTR_LENGTH];    /* the highest key of the last leaf */
+};
+
+/**
+ * bulkBegin(struct bulk_loader *loader, int fileIndex, int count, float fillFactor)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Prepares the loader for count entries. The file must not hold any node yet. A loader of posting
+ * leaves does not need count, since bulkGroup finds the leaves as it fills them.
+ */
+static int bulkBegin(struct bulk_loader *loader, int fileIndex, int count, float fillFactor){
+    int attrLength1 = Files_array[fileIndex].attrLength1;
+    int per_leaf = (int)(leafMaxEntries(fileIndex)*fillFactor);
+    if(per_leaf < 1){
+        per_leaf = 1;
+    }
+
+    int blocks_num;
+    if(bfGetBlockCounter(Files_array[fileIndex].fileDesc, &blocks_num) != BF_OK){
+        AM_errno = AME_COUNTER;
+        return AM_errno;
+    }
+    if(blocks_num != 1){
+        AM_errno = AME_NOT_EMPTY;
+        return AM_errno;
+    }
+
+    loader->fileIndex = fileIndex;
+    loader->first_leaf = blocks_num;
+    loader->leaf = 0;
+    loader->leaf_entries = 0;
+    loader->entries = 0;
+    loader->fillFactor = fillFactor;
+    loader->used = 0;
+    if(Files_array[fileIndex].postings){
+        /* The leaves are closed by bulkGroup as they fill up, so their number is found on the way */
+        loader->leaves = 0;
+        loader->capacity = 16;
+    } else {
+        loader->leaves = (count+per_leaf-1)/per_leaf;
+        loader->base = count/loader->leaves;
+        loader->extra = count%loader->leaves;
+        loader->capacity = loader->leaves;
+    }
+    loader->children = malloc(sizeof(int)*loader->capacity);
+    loader->keys = malloc(attrLength1*loader->capacity);
+    memset(loader->last_key, 0, sizeof(loader->last_key));
+    loader->page = &Files_array[fileIndex].page;
+    return AME_OK;
+}
+
+/**
+ * bulkAdd(struct bulk_loader *loader, const void *value1, const void *value2)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Appends the pair (value1, value2) to the current leaf, allocating it if it is the first entry of the leaf.
+ * The pairs must be given in ascending order of value1.
+ */
+static int bulkAdd(struct bulk_loader *loader, const void *value1, const void *value2){
+    int fileIndex = loader->fileIndex;
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+    int page_blocks = Files_array[fileIndex].page_blocks;
+    int max_entries = leafMaxEntries(fileIndex);
+    int leaf_id = loader->first_leaf+loader->leaf*page_blocks;
+    char *data;
+
+    if(loader->entries == 0){
+        int page_num;
+        if(pageAllocate(fileIndex, loader->page, &page_num) != AME_OK){
+            return AM_errno;
+        }
+        if(page_num != leaf_id){
+            /* Something else allocated a block, so the leaves would not be consecutive */
+            pagePut(fileIndex, loader->page, 0);
+            AM_errno = AME_BLOCKS;
             return AM_errno;
         }
+        data = loader->page->data;
+        loader->leaf_entries = loader->base + (loader->leaf < loader->extra ? 1 : 0);
 
-        char type = 'o';
-        int entries = 1;
-        int next_leaf = -1;
-        int prev_leaf = -1;
+        char type = (loader->leaves == 1) ? 'o' : 'l';
+        int next_leaf = (loader->leaf+1 < loader->leaves) ? leaf_id+page_blocks : -1;
+        int prev_leaf = (loader->leaf > 0) ? leaf_id-page_blocks : -1;
+        memcpy(data, &type, sizeof(char));
+        memcpy(data+sizeof(char), &loader->leaf_entries, sizeof(int));
+        memcpy(data+sizeof(char)+sizeof(int), &next_leaf, sizeof(int));
+        memcpy(data+sizeof(char)+sizeof(int)*2, &prev_leaf, sizeof(int));
 
-        /* Each leaf block holds the following information in the same order:
-         * [ type - the type that shows if the block is a leaf
-         *   entries - the number of entries that the block holds
-         *   next_leaf - the next leaf block that holds bigger values
-         *   prev_leaf - the previous leaf block that holds lower values
-         *
-         *   int max_entries[] - an array that holds the position/offset of the entries in ascending order.
-         *   <entry1, entry2> - the entries themselves for each entry that is in the block in insertion order.
-         * ]
-         */
-        int max_entries = (BF_BLOCK_SIZE - leaf_offset)/(attrLength1 + attrLength2 + sizeof(int));
-        if(max_entries%2 == 1){
-            max_entries--;
+        loader->children[loader->leaf] = leaf_id;
+        separatorKey(fileIndex, loader->last_key, value1, loader->keys+loader->leaf*attrLength1);
+    }
+
+    /* The entries arrive sorted, so they are simply appended to the keys and the values of the leaf */
+    data = loader->page->data;
+    memcpy(data+leaf_offset+loader->entries*attrLength1, value1, attrLength1);
+    memcpy(data+leaf_offset+max_entries*attrLength1+loader->entries*attrLength2, value2, attrLength2);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, attrLength1+attrLength2);
+    memcpy(loader->last_key, value1, attrLength1);
+    loader->entries++;
+
+    if(loader->entries == loader->leaf_entries){
+        if(pagePut(fileIndex, loader->page, 1) != AME_OK){
+            return AM_errno;
+        }
+        loader->leaf++;
+        loader->entries = 0;
+    }
+    return AME_OK;
+}
+
+/**
+ * bulkClose(struct bulk_loader *loader, int last)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Writes the posting leaf that is being filled. Unless it is the last one, the next leaf is the page that
+ * will be allocated right after it.
+ */
+static int bulkClose(struct bulk_loader *loader, int last){
+    int fileIndex = loader->fileIndex;
+    char *data = loader->page->data;
+    char type = (last && loader->leaves == 1) ? 'o' : 'l';
+    int next_leaf = -1;
+
+    if(!last && bfGetBlockCounter(Files_array[fileIndex].fileDesc, &next_leaf) != BF_OK){
+        pagePut(fileIndex, loader->page, 0);
+        AM_errno = AME_COUNTER;
+        return AM_errno;
+    }
+    memcpy(data, &type, sizeof(char));
+    memcpy(data+sizeof(char), &loader->entries, sizeof(int));
+    memcpy(data+sizeof(char)+sizeof(int), &next_leaf, sizeof(int));
+    loader->entries = 0;
+    return pagePut(fileIndex, loader->page, 1);
+}
+
+/**
+ * bulkGroup(struct bulk_loader *loader, const char *entries, int count)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Appends a key with its values to the posting leaves, where entries holds count pairs <value1, value2> with the
+ * same value1, one after the other. The values of a hot key are written to a chain of overflow pages first. A key
+ * goes to the next leaf when it would take the current one over fillFactor, and the values of a key stay together.
+ */
+static int bulkGroup(struct bulk_loader *loader, const char *entries, int count){
+    int fileIndex = loader->fileIndex;
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+    int page_blocks = Files_array[fileIndex].page_blocks;
+    int entry_size = attrLength1+attrLength2;
+    int stride = postingStride(fileIndex);
+    int hot = (count*attrLength2 > postingHotBytes(fileIndex));
+    int first = -1, last = -1;
+    char *data;
+
+    if(hot){
+        struct page_ref *over = &Files_array[fileIndex].new_page;
+        int max_values = (Files_array[fileIndex].page_size-overflow_offset)/attrLength2;
+        for(int i = 0; i < count; i += max_values){
+            int page_num;
+            if(pageAllocate(fileIndex, over, &page_num) != AME_OK){
+                return AM_errno;
+            }
+            /* The pages of the chain are allocated one after the other */
+            char type = 'v';
+            int values = (count-i < max_values) ? count-i : max_values;
+            int next = (i+values < count) ? page_num+page_blocks : -1;
+            memcpy(over->data, &type, sizeof(char));
+            memcpy(over->data+sizeof(char), &values, sizeof(int));
+            memcpy(over->data+sizeof(char)+sizeof(int), &next, sizeof(int));
+            for(int j = 0; j < values; j++){
+                memcpy(over->data+overflow_offset+j*attrLength2, entries+(i+j)*entry_size+attrLength1, attrLength2);
+            }
+            if(pagePut(fileIndex, over, 1) != AME_OK){
+                return AM_errno;
+            }
+            first = (first == -1) ? page_num : first;
+            last = page_num;
+        }
+    }
+
+    int slots = hot ? overflowSlots(fileIndex) : count;
+    int need = stride+slots*attrLength2;
+    int limit = (int)((Files_array[fileIndex].page_size-posting_offset)*loader->fillFactor);
+    if(loader->entries > 0 && loader->used+need > limit && bulkClose(loader, 0) != AME_OK){
+        return AM_errno;
+    }
+
+    if(loader->entries == 0){
+        if(loader->leaves == loader->capacity){
+            loader->capacity *= 2;
+            loader->children = realloc(loader->children, sizeof(int)*loader->capacity);
+            loader->keys = realloc(loader->keys, attrLength1*loader->capacity);
+        }
+        int leaf_id;
+        if(pageAllocate(fileIndex, loader->page, &leaf_id) != AME_OK){
+            return AM_errno;
+        }
+        data = loader->page->data;
+        int prev_leaf = (loader->leaves > 0) ? loader->children[loader->leaves-1] : -1;
+        int zero = 0;
+        memcpy(data+sizeof(char)+sizeof(int)*2, &prev_leaf, sizeof(int));
+        memcpy(data+leaf_offset, &zero, sizeof(int));
+        loader->children[loader->leaves] = leaf_id;
+        separatorKey(fileIndex, loader->last_key, entries, loader->keys+loader->leaves*attrLength1);
+        loader->leaves++;
+        loader->used = 0;
+    }
+
+    /* The keys arrive sorted, so the key and its slots go after the ones of the leaf */
+    data = loader->page->data;
+    int used_slots;
+    memcpy(&used_slots, data+leaf_offset, sizeof(int));
+    memcpy(data+posting_offset+stride*loader->entries, entries, attrLength1);
+    if(hot){
+        char *record = overflowRecord(fileIndex, data, used_slots);
+        memcpy(record, &first, sizeof(int));
+        memcpy(record+sizeof(int), &last, sizeof(int));
+    } else {
+        for(int i = 0; i < count; i++){
+            memcpy(postingSlot(fileIndex, data, used_slots+i), entries+i*entry_size+attrLength1, attrLength2);
+        }
+    }
+    used_slots += slots;
+    postingSetEnd(fileIndex, data, loader->entries, hot ? (used_slots | OVERFLOW_FLAG) : used_slots);
+    memcpy(data+leaf_offset, &used_slots, sizeof(int));
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, need);
+    memcpy(loader->last_key, entries, attrLength1);
+    loader->entries++;
+    loader->used += need;
+    return AME_OK;
+}
+
+/**
+ * bulkFinish(struct bulk_loader *loader)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Builds the internal levels on top of the leaves, one level at a time, until a single node is left.
+ * That node becomes the root of the B+ Tree. The loader is released in any case.
+ */
+static int bulkFinish(struct bulk_loader *loader){
+    int fileIndex = loader->fileIndex;
+    int attrLength1 = Files_array[fileIndex].attrLength1;
+    int node_entry_size = sizeof(int)+attrLength1;
+    char *pairs = Files_array[fileIndex].pairs;
+
+    int result = AME_OK;
+    int level = loader->leaves;
+    while(result == AME_OK && level > 1){
+        int node_max = nodeMaxEntries(fileIndex);
+        if(Files_array[fileIndex].compress_keys){
+            /* No key of a node takes more than the longest separator of the level and its '\0' */
+            int longest = 0;
+            for(int i = 1; i < level; i++){
+                int length = strnlen(loader->keys+i*attrLength1, attrLength1);
+                longest = (length > longest) ? length : longest;
+            }
+            longest = (longest < attrLength1) ? longest+1 : attrLength1;
+            node_max = (Files_array[fileIndex].page_size-node_offset-sizeof(int)-NODE_KEYS_HEADER)/(sizeof(int)+longest);
+        }
+        int per_node = (int)(node_max*loader->fillFactor);
+        if(per_node < 1){
+            per_node = 1;
+        }
+
+        /* Each node of the new level gets children+1 pointers, spread evenly like the leaves */
+        int nodes = (level+per_node)/(per_node+1);
+        if(nodes > 1 && level/nodes < 2){
+            nodes = (level+node_max)/(node_max+1);
         }
+        int base = level/nodes, extra = level%nodes;
+        char type = (nodes == 1) ? 'r' : 'n';
 
-        data = BF_Block_GetData(block);
+        int child = 0;
+        for(int n = 0; n < nodes; n++){
+            int children = base + (n < extra ? 1 : 0);
+            int entries = children-1;
 
-        memcpy(data, &type, sizeof(char));
-        memcpy(data+sizeof(char), &entries, sizeof(int));
-        memcpy(data+sizeof(char)+sizeof(int), &next_leaf, sizeof(int));
-        memcpy(data+sizeof(char)+sizeof(int)*2, &prev_leaf, sizeof(int));
+            int node_id;
+            if(pageAllocate(fileIndex, loader->page, &node_id) != AME_OK){
+                result = AM_errno;
+                break;
+            }
+            char *data = loader->page->data;
+            memcpy(data, &type, sizeof(char));
+            memcpy(data+node_offset, &loader->children[child], sizeof(int));
+            for(int i = 1; i < children; i++){
+                memcpy(pairs+node_entry_size*(i-1), loader->keys+(child+i)*attrLength1, attrLength1);
+                memcpy(pairs+node_entry_size*(i-1)+attrLength1, &loader->children[child+i], sizeof(int));
+            }
+            nodeEncode(fileIndex, data, pairs, entries);
+            if(pagePut(fileIndex, loader->page, 1) != AME_OK){
+                result = AM_errno;
+                break;
+            }
 
-        int entry_offset = -1; 
-        for(int i = 0; i < max_entries; i++){
-            memcpy(data+leaf_offset+i*sizeof(int), &entry_offset, sizeof(int));
+            /* The new node takes the place n of the level, which has already been read */
+            loader->children[n] = node_id;
+            memmove(loader->keys+n*attrLength1, loader->keys+child*attrLength1, attrLength1);
+            child += children;
         }
+        level = nodes;
+    }
 
-        memcpy(data+leaf_offset+max_entries*sizeof(int), value1, attrLength1);
-        memcpy(data+leaf_offset+max_entries*sizeof(int)+attrLength1, value2, attrLength2);
+    if(result == AME_OK && loader->leaves > 0){
+        result = writeRoot(fileIndex, loader->children[0]);
+    }
 
-        entry_offset = leaf_offset+max_entries*sizeof(int);
-        memcpy(data+leaf_offset, &entry_offset, sizeof(int));
+    free(loader->children);
+    free(loader->keys);
+    return result;
+}
 
-        BF_Block_SetDirty(block);
-        if(BF_UnpinBlock(block) != BF_OK){
-            AM_errno = AME_UNPIN;
-            return AM_errno;
-        }
-    } else {
-        /* If the B+Tree has already been built, then use a recursive insertEntry */
-        void *newchildentry = NULL;
-        int result = insertEntry(fileDesc, root, value1, value2, newchildentry);
-        if(result != 0){
-            AM_errno = AME_INSERT_ERROR;
-            return AM_errno;
-        }
-    }
-    BF_Block_Destroy(&block);
-    return AME_OK;
+/* The operations and length of the keys that AM_BulkLoad sorts, since qsort passes nothing else to its comparator */
+static _Thread_local const struct key_traits *sort_keys;
+static _Thread_local int sort_attrLength;
+
+static int compareBulkEntries(const void *first, const void *second){
+    return sort_keys->compare(first, second, sort_attrLength);
 }
 
 /**
- * insertEntry(int fileDesc, int nodePointer, void *value1, void *value2, void *newchildentry)
- *  returns: 0 - if it runs correctly, Some error code - if it has an error.
- *
- *  This is the recursive insert entry that follows the path from the root down to the leaf that the entry needs to be placed.
- *  Then it inserts the entry if there is space, or it splits the leaf into two leafs with equal number of entries, and recursively sends 
- *  the key of the entry to be inserted to the parent node(which may need to be splitted).
+ * bulkLoadLatched(int fileDesc, void *entries, int count, float fillFactor)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
  *
- *  fileDesc - holds the index of the Files_array in which the file that the insert will take place is.
- *  nodePointer - holds the number of the node/block that the insertion will take place.
- *  newchildentry - is NULL except for the case that there was a split, and it holds the pair <key-value, block-number> that will be inserted to the node parent.
- *                  key-value is the first value of the new block that was created due to the split.
- *                  block-number is the number of the new block that holds the splitted entries.
+ * The load of AM_BulkLoad, with the latch of the index held exclusively.
  */
-int insertEntry(int fileDesc, int nodePointer, void *value1, void *value2, void *newchildentry){
-    int root = Files_array[fileDesc].rootBlock;
-    int attrLength1 = Files_array[fileDesc].attrLength1, attrLength2 = Files_array[fileDesc].attrLength2;
-    char attrType1 = Files_array[fileDesc].attrType1, attrType2 = Files_array[fileDesc].attrType2;
-    int file_id = Files_array[fileDesc].fileDesc;
+static int bulkLoadLatched(int fileDesc, void *entries, int count, float fillFactor){
+    if(Files_array[fileDesc].map != NULL){
+        AM_errno = AME_READ_ONLY;
+        return AM_errno;
+    }
+    if(fillFactor <= 0 || fillFactor > 1 || count < 0){
+        AM_errno = AME_FILL_FACTOR;
+        return AM_errno;
+    }
+    if(count == 0){
+        return AME_OK;
+    }
 
-    int blocks_num;
+    int attrLength1 = Files_array[fileDesc].attrLength1, attrLength2 = Files_array[fileDesc].attrLength2;
+    const struct key_traits *keys = Files_array[fileDesc].keys;
     int entry_size = attrLength1+attrLength2;
-    int node_entry_size = sizeof(int)+attrLength1;
-    int max_entries = (BF_BLOCK_SIZE-leaf_offset)/(attrLength1+attrLength2+sizeof(int));
-    if(max_entries%2 == 1){
-        max_entries--;
+    char *sorted = entries;
+
+    for(int i = 1; i < count; i++){
+        if(keys->compare(sorted+(i-1)*entry_size, sorted+i*entry_size, attrLength1) > 0){
+            /* Sort a copy, the entries of the caller are left as they are */
+            sorted = malloc((size_t)count*entry_size);
+            memcpy(sorted, entries, (size_t)count*entry_size);
+            sort_keys = keys;
+            sort_attrLength = attrLength1;
+            qsort(sorted, count, entry_size, compareBulkEntries);
+            break;
+        }
     }
-    int d = max_entries/2;
 
-    BF_Block *block;
-    BF_Block_Init(&block);
-    char *data;
+    struct bulk_loader loader;
+    int result = bulkBegin(&loader, fileDesc, count, fillFactor);
+    if(result == AME_OK){
+        if(Files_array[fileDesc].postings){
+            /* Every run of pairs with the same value1 becomes one key of a posting leaf */
+            int first = 0;
+            for(int i = 1; result == AME_OK && i <= count; i++){
+                if(i == count || keys->compare(sorted+first*entry_size, sorted+i*entry_size, attrLength1) != 0){
+                    result = bulkGroup(&loader, sorted+first*entry_size, i-first);
+                    first = i;
+                }
+            }
+            if(result == AME_OK){
+                result = bulkClose(&loader, 1);
+            }
+        } else {
+            for(int i = 0; result == AME_OK && i < count; i++){
+                result = bulkAdd(&loader, sorted+i*entry_size, sorted+i*entry_size+attrLength1);
+            }
+        }
+        if(result == AME_OK){
+            result = bulkFinish(&loader);
+            statAdd(&Files_array[fileDesc].stats.bulk_entries, count);
+        } else {
+            free(loader.children);
+            free(loader.keys);
+        }
+    }
+
+    if(sorted != entries){
+        free(sorted);
+    }
+    return result;
+}
 
-    if(BF_GetBlock(file_id, nodePointer, block) != BF_OK){
-        AM_errno = AME_GETBLOCK;
+/**
+ * AM_BulkLoad(int fileDesc, void *entries, int count, float fillFactor)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * This function builds the B+ Tree of an empty file at once, from the count pairs <value1, value2>
+ * that are stored one after the other in entries (attrLength1+attrLength2 bytes each). The pairs
+ * are sorted first, unless they are already in ascending order. Then the leaves are written in a
+ * single sequential pass, each one filled up to fillFactor of its capacity, and the internal
+ * levels are built on top of them the same way. This is much faster than calling AM_InsertEntry
+ * count times, and the leaves end up full instead of half-empty after the splits.
+ */
+int AM_BulkLoad(int fileDesc, void *entries, int count, float fillFactor){
+    if(fileDesc < 0 || fileDesc >= MAX_OPEN_FILES || Files_array[fileDesc].fileDesc == -1){
+        AM_errno = AME_NOTOPEN;
         return AM_errno;
     }
-    data =  BF_Block_GetData(block);
 
-    char type;
-    int entries;
-    memcpy(&type, data, sizeof(char));
-    memcpy(&entries, data+sizeof(char), sizeof(int));
+    latchExclusive(fileDesc);
+    int result = bulkLoadLatched(fileDesc, entries, count, fillFactor);
+    latchRelease(fileDesc);
+    return result;
+}
 
-    if(type == 'o' || type == 'l'){
-        /* In this case the block is always a leaf node, either a root or a plain leaf */
-        if(entries == max_entries){
-            /* There is no space in this leaf node (L)
-             * Split L: first d entries stay, rest move to brand new node L2
-             */
-            int next_leaf_id;
-            memcpy(&next_leaf_id, data+sizeof(char)+sizeof(int), sizeof(int));
-
-            char new_type = 'l';
-            if(type == 'o'){
-                /* The root node becomes a leaf node */
-                memcpy(data, &new_type, sizeof(char));
-            }
-            memcpy(data+sizeof(char), &d, sizeof(int));
+/**
+ * firstLeaf(int fileIndex, struct page_ref *page)
+ *  returns: the block number of the leaf with the lowest values, Some error code - if it fails.
+ *
+ * Follows the first pointer of every internal node, from the root down to the leaves, reading them through page.
+ */
+static int firstLeaf(int fileIndex, struct page_ref *page){
+    int node = Files_array[fileIndex].latch->rootBlock;
+    char *data;
+    char type = 'r';
+
+    while(type == 'r' || type == 'n'){
+        if(pageGet(fileIndex, node, page) != AME_OK){
+            return AM_errno;
+        }
+        data = page->data;
+        memcpy(&type, data, sizeof(char));
+        if(type == 'r' || type == 'n'){
+            memcpy(&node, data+node_offset, sizeof(int));
+        }
+        if(pagePut(fileIndex, page, 0) != AME_OK){
+            return AM_errno;
+        }
+    }
+    return node;
+}
 
-            BF_Block *new_block_leaf;
-            BF_Block_Init(&new_block_leaf);
-            char *sata;
+/* The values of the key that compactCopy has reached, as pairs <value1, value2> one after the other */
+struct compact_group{
+    char *entries;
+    int count;
+    int capacity;
+};
 
-            int new_leaf_id;
-            if(BF_GetBlockCounter(file_id, &new_leaf_id) != BF_OK){
-                AM_errno = AME_BLOCKS;
-                return AM_errno;
-            }
-            /* Set the next_leaf 'pointer' of the first leaf node to 'point' to the new leaf node. */
-            memcpy(data+sizeof(char)+sizeof(int), &new_leaf_id, sizeof(int));
+static void compactAppend(int fileIndex, struct compact_group *group, const char *value1, const char *value2){
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+    if(group->count == group->capacity){
+        group->capacity *= 2;
+        group->entries = realloc(group->entries, (size_t)group->capacity*(attrLength1+attrLength2));
+    }
+    char *entry = group->entries+(size_t)group->count*(attrLength1+attrLength2);
+    memcpy(entry, value1, attrLength1);
+    memcpy(entry+attrLength1, value2, attrLength2);
+    group->count++;
+}
 
-            if(BF_AllocateBlock(file_id, new_block_leaf) != BF_OK){
-                AM_errno = AME_ALLOCATE;
-                return AM_errno;
-            }
-            sata = BF_Block_GetData(new_block_leaf);
+/**
+ * compactCopy(int fileIndex, struct bulk_loader *loader)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Walks the leaves of the index fileIndex through next_leaf and gives every key with all of its values to
+ * bulkGroup of the loader, which writes posting leaves. The values of a key are gathered first, from a plain
+ * leaf (where they may go on in the next leaf), from the slots of a posting leaf or from its overflow pages.
+ */
+static int compactCopy(int fileIndex, struct bulk_loader *loader){
+    const struct key_traits *keys = Files_array[fileIndex].keys;
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+    int postings = Files_array[fileIndex].postings;
+    int max_entries = leafMaxEntries(fileIndex);
+    int stride = postingStride(fileIndex);
+    struct page_ref *page = &Files_array[fileIndex].page, *over = &Files_array[fileIndex].new_page;
+
+    int blocks_num;
+    if(bfGetBlockCounter(Files_array[fileIndex].fileDesc, &blocks_num) != BF_OK){
+        AM_errno = AME_COUNTER;
+        return AM_errno;
+    }
+    int leaf = (blocks_num == 1) ? -1 : firstLeaf(fileIndex, &Files_array[fileIndex].page);
 
-            memcpy(sata, &new_type, sizeof(char));
-            memcpy(sata+sizeof(char), &d, sizeof(int));
-            memcpy(sata+sizeof(char)+sizeof(int), &next_leaf_id, sizeof(int));
-            memcpy(sata+sizeof(char)+sizeof(int)*2, &nodePointer, sizeof(int));
+    struct compact_group group;
+    group.count = 0;
+    group.capacity = 64;
+    group.entries = malloc((size_t)group.capacity*(attrLength1+attrLength2));
 
-            for(int i = 0; i < d; i++){
-                int new_entry_position = leaf_offset + sizeof(int)*max_entries + i*entry_size;
-                memcpy(sata+leaf_offset+sizeof(int)*i, &new_entry_position, sizeof(int));
+    int result = AME_OK;
+    while(result == AME_OK && leaf != -1){
+        if(pageGet(fileIndex, leaf, page) != AME_OK){
+            result = AM_errno;
+            break;
+        }
+        char *data = page->data;
+        int entries;
+        memcpy(&entries, data+sizeof(char), sizeof(int));
+        memcpy(&leaf, data+sizeof(char)+sizeof(int), sizeof(int));
 
-                int previous_entry_position = leaf_offset + sizeof(int)*max_entries + (d+i)*entry_size;
-                memcpy(sata+new_entry_position, data+previous_entry_position, entry_size);
+        for(int i = 0; result == AME_OK && i < entries; i++){
+            char *key = postings ? data+posting_offset+stride*i : data+leaf_offset+i*attrLength1;
+            if(group.count > 0 && keys->compare(group.entries, key, attrLength1) != 0){
+                /* A new key begins, so all the values of the previous one are known */
+                result = bulkGroup(loader, group.entries, group.count);
+                group.count = 0;
             }
 
-            void *value = malloc(attrLength1);
-            int first_entry_position = leaf_offset + sizeof(int)*max_entries;
-            memcpy(value, sata+first_entry_position, attrLength1);
-
-            int node;
-            if(attrType1 == 'i'){
-                if ( *(int*)value1 < *(int*)value ){
-                    node = nodePointer;
-                } else {
-                    node = new_leaf_id;
+            int start, end;
+            if(!postings){
+                compactAppend(fileIndex, &group, key, data+leaf_offset+max_entries*attrLength1+i*attrLength2);
+            } else if(!postingRun(fileIndex, data, i, &start, &end)){
+                for(int j = start; j < end; j++){
+                    compactAppend(fileIndex, &group, key, postingSlot(fileIndex, data, j));
                 }
-            } else if(attrType1 == 'f'){
-                if ( *(float*)value1 < *(float*)value ){
-                    node = nodePointer;
-                } else {
-                    node = new_leaf_id;
-                }
-            } else if(attrType1 == 'c'){
-                if ( strcmp(value1, value) < 0){
-                    node = nodePointer;
-                } else {
-                    node = new_leaf_id;
+            } else {
+                int next;
+                memcpy(&next, overflowRecord(fileIndex, data, start), sizeof(int));
+                while(result == AME_OK && next != -1){
+                    int values;
+                    if(pageGet(fileIndex, next, over) != AME_OK){
+                        result = AM_errno;
+                        break;
+                    }
+                    memcpy(&values, over->data+sizeof(char), sizeof(int));
+                    memcpy(&next, over->data+sizeof(char)+sizeof(int), sizeof(int));
+                    for(int j = 0; j < values; j++){
+                        compactAppend(fileIndex, &group, key, over->data+overflow_offset+j*attrLength2);
+                    }
+                    result = pagePut(fileIndex, over, 0);
                 }
-            } else{
-                AM_errno = AME_ERROR;
-                return AM_errno;
             }
+        }
 
-               
-            BF_Block_SetDirty(block);
-            BF_Block_SetDirty(new_block_leaf);
-            if(BF_UnpinBlock(block) != BF_OK){
-                AM_errno = AME_UNPIN;
-                return AM_errno;
-            }
-            if(BF_UnpinBlock(new_block_leaf) != BF_OK){
-                AM_errno = AME_UNPIN;
-                return AM_errno;
-            }
+        if(result == AME_OK){
+            result = pagePut(fileIndex, page, 0);
+        } else {
+            pagePut(fileIndex, page, 0);
+        }
+    }
 
-            int result = insertEntry(fileDesc, node, value1, value2, newchildentry);
-            if(result != 1){
-                AM_errno = AME_INSERT_ERROR;
-                return AM_errno;
-            }
-            
-            free(value);
-
-            if(type == 'o'){
-                /* The leaf-node was also a root node, so a new root node must be made, this time it will never be a leaf-node again */
-                int new_root_block;
-                if(BF_GetBlockCounter(file_id, &new_root_block) != BF_OK){
-                    AM_errno = AME_BLOCKS;
-                    return AM_errno;
-                }
-                int entries = 1;
-                if(BF_AllocateBlock(file_id, block) != BF_OK){
-                    AM_errno = AME_ALLOCATE;
-                    return AM_errno;
-                }
-                data = BF_Block_GetData(block);
-                memcpy(data, &type, sizeof(char));
-                memcpy(data+sizeof(char), &entries, sizeof(int));
-                memcpy(data+node_offset, &nodePointer, sizeof(int));
-                memcpy(data+node_offset+sizeof(int), value1, attrLength1);
-                memcpy(data+node_offset+sizeof(int)+attrLength1, &new_leaf_id, sizeof(int));
-                BF_Block_SetDirty(block);
-                if(BF_UnpinBlock(block) != BF_OK){
-                    AM_errno = AME_UNPIN;
-                    return AM_errno;
-                }
-                Files_array[fileDesc].rootBlock = new_root_block;
-                if(BF_GetBlock(file_id, 0, block) != BF_OK){
-                    AM_errno = AME_GETBLOCK;
-                    return AM_errno;
-                }
-                data = BF_Block_GetData(block);
-                memcpy(data+sizeof(char)*3+sizeof(int)*2, &new_root_block, sizeof(int));
-                BF_Block_SetDirty(block);
-                if(BF_UnpinBlock(block) != BF_OK){
-                    AM_errno = AME_UNPIN;
-                    return AM_errno;
-                }
+    if(result == AME_OK && group.count > 0){
+        result = bulkGroup(loader, group.entries, group.count);
+    }
+    free(group.entries);
+    return result;
+}
 
-            }
+/**
+ * openElsewhere(int fileDesc)
+ *  returns: 1 - if the file of the index is open at another position of the Files_array too, 0 - otherwise.
+ */
+static int openElsewhere(int fileDesc){
+    for(int i = 0; i < MAX_OPEN_FILES; i++){
+        if(i != fileDesc && Files_array[i].fileName != NULL && strcmp(Files_array[i].fileName, Files_array[fileDesc].fileName) == 0){
+            return 1;
+        }
+    }
+    return 0;
+}
 
-            newchildentry = malloc(sizeof(int)+attrLength1);
-            if(BF_GetBlock(file_id, new_leaf_id, block) != BF_OK){
-                AM_errno = AME_GETBLOCK;
-                return AM_errno;
-            }
+/**
+ * compactCheck(int fileDesc, int *copy)
+ *  returns: AME_OK - if the index may be compacted, Some error code - otherwise.
+ *
+ * Checks that no scan of the index is open and that the file is not open at another position of the Files_array,
+ * and stores in copy an empty position for the file that AM_Compact writes. It is called with table_lock held.
+ */
+static int compactCheck(int fileDesc, int *copy){
+    for(int i = 0; i < MAX_OPEN_SCANS; i++){
+        if(Scans_array[i].value != NULL && Scans_array[i].fileDesc == fileDesc){
+            AM_errno = AME_OPEN_SCAN;
+            return AM_errno;
+        }
+    }
 
-            data = BF_Block_GetData(block);
-            memcpy(&first_entry_position, data+leaf_offset, sizeof(int));
-            memcpy(newchildentry, data+first_entry_position, attrLength1);
-            memcpy(newchildentry+attrType1, &new_leaf_id, sizeof(int));
-            if(BF_UnpinBlock(block) != BF_OK){
-                AM_errno = AME_UNPIN;
-                return AM_errno;
-            }
-           return 0;
-        } else {
-            /* L has space, put entry on it, set newChildEntry to NULL and return
-             * The entry will be placed after the last entry of the leaf node, and the array with the positions of the ascending order of the entries will be updated.
-             */
-            int entry_position = leaf_offset + max_entries*sizeof(int) + entries*entry_size;
-            memcpy(data+entry_position, value1, attrLength1);
-            int second_field_position = entry_position+attrLength1;
-            memcpy(data+second_field_position, value2, attrLength2);
-            entries++;
-            memcpy(data+sizeof(char), &entries, sizeof(int));
-
-            int i = 0;
-            int flag = -1;
-            void *value = malloc(attrLength1);
-            
-            while(flag == -1 && i < entries-1){
-                /* Find the position (i) of the array which holds the value that is bigger than the new value inserted. */
-                int test_entry_position = leaf_offset + max_entries*sizeof(int) + entry_size*i;
-                memcpy(value, data+test_entry_position, attrLength1);
-                if(attrType1 == 'i'){
-                    if( *(int*)value1 < *(int*)value ){
-                        flag = 0;
-                        break;
-                    }
-                } else if(attrType1 == 'f'){
-                    if( *(float*)value1 < *(float*)value ){
-                        flag = 0;
-                        break;
-                    }
+    if(openElsewhere(fileDesc)){
+        AM_errno = AME_COMPACT;
+        return AM_errno;
+    }
+    *copy = -1;
+    for(int i = 0; i < MAX_OPEN_FILES && *copy == -1; i++){
+        if(Files_array[i].fileDesc == -1){
+            *copy = i;
+        }
+    }
+    if(*copy == -1){
+        AM_errno = AME_OPENINDEX;
+        return AM_errno;
+    }
+    return AME_OK;
+}
 
-                } else if(attrType1 == 'c'){
-                    if( strcmp(value1, value) < 0){
-                        flag = 0;
-                        break;
-                    }
-                } else{
-                    AM_errno = AME_ERROR;
-                    return AM_errno;
-                }
+/**
+ * compactLatched(int fileDesc, float fillFactor, int *closed)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * The compaction of AM_Compact, with the latch of the index held exclusively. table_lock is held only while a
+ * position of the Files_array is taken for the copy and given back, and while the old file is swapped for the
+ * copy, so the other indexes go on while the copy is written. closed is set if the index could not be opened
+ * again, and then the latch has already been let go.
+ */
+static int compactLatched(int fileDesc, float fillFactor, int *closed){
+    if(Files_array[fileDesc].map != NULL){
+        AM_errno = AME_READ_ONLY;
+        return AM_errno;
+    }
+    if(fillFactor <= 0 || fillFactor > 1){
+        AM_errno = AME_FILL_FACTOR;
+        return AM_errno;
+    }
 
+    /* The name does not change while the latch is held exclusively */
+    char *fileName = Files_array[fileDesc].fileName;
+    char *copy_name = malloc(strlen(fileName)+sizeof(".compact"));
+    sprintf(copy_name, "%s.compact", fileName);
+    remove(copy_name);
+    if(AM_CreateIndexWithPageSize(copy_name, Files_array[fileDesc].attrType1, Files_array[fileDesc].attrLength1,
+                                  Files_array[fileDesc].attrType2, Files_array[fileDesc].attrLength2,
+                                  Files_array[fileDesc].page_size) != AME_OK){
+        remove(copy_name);
+        free(copy_name);
+        return AM_errno;
+    }
 
-                i++;
-            }
+    pthread_mutex_lock(&table_lock);
+    int copy = -1;
+    int result = compactCheck(fileDesc, &copy);
+    if(result == AME_OK && openIndex(copy, copy_name) != AME_OK){
+        result = AM_errno;
+    }
+    pthread_mutex_unlock(&table_lock);
+    if(result != AME_OK){
+        remove(copy_name);
+        free(copy_name);
+        return result;
+    }
+    /* No other thread knows the copy, but its blocks stay out of the cache_shards while it is written */
+    latchExclusive(copy);
 
-            if(flag == -1){
-                /* The new value inserted is the biggest of the entries in the leaf node.
-                 * Place the new entry_position to the last entry of the array */
-                int entry_in_array_position = leaf_offset + (entries-1)*sizeof(int);
-                memcpy(data+entry_in_array_position, &entry_position, sizeof(int));
-            } else {
-                /* Place the new entry_position so that the entries of the array remain in ascending order:
-                 *  Move all the entries of the array one position starting from the position that the new entry_position needs to be keeped.
-                 *  Place the new entry_position to the array.
-                 */
-                int temp_this, temp_next;
-                memcpy(&temp_this, data+leaf_offset+(i)*sizeof(int), sizeof(int));
-                memcpy(&temp_next, data+leaf_offset+(i+1)*sizeof(int), sizeof(int));
-
-                for(int j = i+1; j < entries; j++){
-                    memcpy(data+leaf_offset+j*sizeof(int), &temp_this, sizeof(int));
-                    temp_this = temp_next;
-                    memcpy(&temp_next, data+leaf_offset+(j+1)*sizeof(int), sizeof(int));
-                }
-                memcpy(data+leaf_offset+i*sizeof(int), &entry_position, sizeof(int));
-            }
-            free(newchildentry);
-            newchildentry = NULL;
-            BF_Block_SetDirty(block);
-            if(BF_UnpinBlock(block) != BF_OK){
-                AM_errno = AME_UNPIN;
-                return AM_errno;
-            }
-            return 0;
+    struct bulk_loader loader;
+    result = bulkBegin(&loader, copy, 0, fillFactor);
+    if(result == AME_OK){
+        result = compactCopy(fileDesc, &loader);
+        if(result == AME_OK && loader.entries > 0){
+            result = bulkClose(&loader, 1);
         }
-    } else if ( type == 'r' || type == 'n' ){
-        /* In this case the node was an internal node, either a root or a plain node. 
-         * We need to find the leaf node in which the new value has to be inserted.
-         */
-        int next_node;
-        for(int i = 0; i < entries; i++){
-            void *left_value = malloc(attrLength1);
-            void *right_value = malloc(attrLength1);
-            int node_entry_size = sizeof(int)+attrLength1;
-
-            memcpy(&next_node, data+node_offset+entry_size*i, sizeof(int));
-            memcpy(left_value, data+node_offset+sizeof(int)+node_entry_size*i, attrLength1);
-            memcpy(right_value, data+node_offset+sizeof(int)+node_entry_size*(i+1), attrLength1);
-            if(attrType1 == 'i'){
-                if( (*(int*)left_value <= *(int*)value1) && (*(int*)right_value > *(int*)value1)){
-                    /* If the value is between the left_value and the right_value then we have found our node */
-                    break;
-                }
-            } else if(attrType1 == 'f'){
-                if( (*(float*)left_value <= *(float*)value1) && (*(float*)right_value > *(float*)value1)){
-                    /* If the value is between the left_value and the right_value then we have found our node */
-                    break;
-                }
-            } else if(attrType1 == 'c'){
-                if( (strcmp(left_value, value1) <= 0) && (strcmp(right_value, value1) > 0)){
-                    /* If the value is between the left_value and the right_value then we have found our node */
-                    break;
-                }
-            } else{
-                AM_errno = AME_ERROR;
-                return AM_errno;
+        if(result == AME_OK){
+            result = bulkFinish(&loader);
+        } else {
+            if(loader.entries > 0){
+                pagePut(copy, loader.page, 0);
             }
-            
+            free(loader.children);
+            free(loader.keys);
         }
-        if(next_node == 0){
-            AM_errno = AME_ERROR;
-            return AM_errno;
+    }
+
+    /* The work of the copy is counted for the index that it replaces */
+    AM_Stats stats = Files_array[fileDesc].stats;
+    addStats(&stats, &Files_array[copy].stats);
+    int copy_id = Files_array[copy].fileDesc;
+    latchRelease(copy);
+    pthread_mutex_lock(&table_lock);
+    latchDetach(copy);
+    releaseIndex(copy);
+    pthread_mutex_unlock(&table_lock);
+    if(bfCloseFile(copy_id) != BF_OK && result == AME_OK){
+        AM_errno = AME_CLOSE;
+        result = AM_errno;
+    }
+    if(result != AME_OK){
+        remove(copy_name);
+        free(copy_name);
+        return result;
+    }
+
+    /* The old file is closed before the new one takes its name, with table_lock held so that no other position
+     * opens it meanwhile. If the file was opened at another position while the copy was written, or it cannot
+     * be closed, the index stays as it was */
+    pthread_mutex_lock(&table_lock);
+    if(openElsewhere(fileDesc)){
+        AM_errno = AME_COMPACT;
+        result = AM_errno;
+    } else if(bfCloseFile(Files_array[fileDesc].fileDesc) != BF_OK){
+        AM_errno = AME_CLOSE;
+        result = AM_errno;
+    }
+    if(result != AME_OK){
+        pthread_mutex_unlock(&table_lock);
+        remove(copy_name);
+        free(copy_name);
+        return result;
+    }
+    char *name = malloc(strlen(fileName)+1);
+    strcpy(name, fileName);
+    if(rename(copy_name, name) != 0){
+        AM_errno = AME_COMPACT;
+        result = AM_errno;
+        remove(copy_name);
+    }
+
+    /* Then the index is opened again at the same position, from the new file or else from the old one. If that
+     * fails too, the position is empty and its latch is let go here, since AM_CloseIndex cannot reach it */
+    releaseIndex(fileDesc);
+    if(openIndex(fileDesc, name) != AME_OK){
+        result = AM_errno;
+        latchUnlock(Files_array[fileDesc].latch);
+        latchDetach(fileDesc);
+        *closed = 1;
+    } else {
+        Files_array[fileDesc].stats = stats;
+        /* The file that the latch read ahead in is not the one with the name any more */
+        struct index_latch *latch = Files_array[fileDesc].latch;
+        if(latch->prefetch_fd != -1){
+            close(latch->prefetch_fd);
         }
-       
-        if(newchildentry == NULL){
-            /* If the newchildentry is NULL then the insertion was finished without splitting
-             * and we need to go down to insert to the next node.*/
-            int result = insertEntry(fileDesc, next_node, value1, value2, newchildentry);
-            if(result != 1){
-                AM_errno = AME_INSERT_ERROR;
-                return AM_errno;
-            }
-            return 0;
-        } else {
-            /* Else the previous insertion splitted the node and the newchildentry holds the following:
-             * <key-value, block_number> : key-value is the lower value of the new block that was created: block_number is the block number that holds that value.
-             * The new entry that has to be inserted in the internal node is the pair <key-value, block_number> so that the entries in the node are keeped in ascending order.
-             */
-            if(entries == max_entries){
-                /* Split N: 2d+1 key values and 2d+2 nodepointers.
-                 *  First d key values and d+1 pointers stay.
-                 *  Last d keys and d+1 pointers move to new node N2
-                 * Then we add the newchildentry to the corrensponding node.
-                 */
-                BF_Block *new_block_node;
-                BF_Block_Init(&new_block_node);
-                char *sata;
-                
-                void *value = malloc(attrLength1);
-                void *new_value = malloc(attrLength1);
-
-                memcpy(data+sizeof(char), &d, sizeof(int));
-
-                int new_node_id;
-                if(BF_GetBlockCounter(file_id, &new_node_id) != BF_OK){
-                    AM_errno = AME_BLOCKS;
-                    return AM_errno;
-                }
-                if(BF_AllocateBlock(file_id, new_block_node) != BF_OK){
-                    AM_errno = AME_BLOCKS;
-                    return AM_errno;
-                }
-                char new_type = 'n';
-                sata = BF_Block_GetData(new_block_node);
-                memcpy(sata, &new_type, sizeof(char));
-                memcpy(sata+sizeof(char), &d, sizeof(int));
-                int first_pointer;
-                memcpy(&first_pointer, data+node_offset+node_entry_size*d, sizeof(int));
-                memcpy(sata+node_offset, &first_pointer, sizeof(int));
-
-                for(int i = 0; i < d; i++){
-                    memcpy(sata+node_offset+sizeof(int)+node_entry_size*i, data+node_offset+sizeof(int)+node_entry_size*(d+i), node_entry_size);
-                }
+        latch->prefetch_fd = open(name, O_RDONLY);
+    }
+    pthread_mutex_unlock(&table_lock);
 
-                memcpy(value, sata+node_offset+sizeof(int), attrLength1);
-                memcpy(new_value, newchildentry, attrLength1);
+    free(name);
+    free(copy_name);
+    return result;
+}
 
-                int node;
-                if( *(int*)new_value < *(int*)value){
-                    node = nodePointer;
-                } else {
-                    node = new_node_id;
-                }
+/**
+ * AM_Compact(int fileDesc, float fillFactor)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * This function rewrites the B+ Tree of the open index fileDesc, so that its leaves are
+ * allocated one after the other in the order of their keys, each one filled up to fillFactor
+ * of its page, and the file has no free pages. After many splits the next_leaf of a leaf is
+ * usually far from it in the file, and a range scan reads the file back and forth; after the
+ * compaction it reads it forward. The leaves of a file of an older format become posting leaves.
+ *
+ * The tree is built with the bulk loader in a new file, whose name is fileName followed by
+ * ".compact", and the root is written to its first block. Then the new file takes the place
+ * of the old one at once, with rename, so the file on the disk holds either the old tree or
+ * the new one. The index stays open at the same fileDesc. There must not be opened scans of
+ * the index, and the file must not be opened at another position of the Files_array.
+ */
+int AM_Compact(int fileDesc, float fillFactor){
+    if(fileDesc < 0 || fileDesc >= MAX_OPEN_FILES || Files_array[fileDesc].fileDesc == -1){
+        AM_errno = AME_NOTOPEN;
+        return AM_errno;
+    }
 
-                int result = insertEntry(fileDesc, node, value1, value2, newchildentry);
-                if(result != 0){
-                    AM_errno = AME_INSERT_ERROR;
-                    return AM_errno;
-                }
+    int closed = 0;
+    latchExclusive(fileDesc);
+    int result = compactLatched(fileDesc, fillFactor, &closed);
+    if(!closed){
+        latchRelease(fileDesc);
+    }
+    return result;
+}
 
-                BF_Block_SetDirty(block);
-                BF_Block_SetDirty(new_block_node);
-                if(BF_UnpinBlock(block) != BF_OK){
-                    AM_errno = AME_UNPIN;
-                    return AM_errno;
-                }
-                if(BF_UnpinBlock(new_block_node) != BF_OK){
-                    AM_errno = AME_UNPIN;
-                    return AM_errno;
-                }
+/**
+ * scanStart(int fileIndex, int op, void *value, struct page_ref *page, int *leaf_block, int *position)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Finds the leaf and the position in it that a scan with the operator op has to start from, reading the nodes
+ * through the page of the scan.
+ * EQUAL and GREATER_THAN_OR_EQUAL start from the first key that is >= value, GREATER_THAN from the first
+ * key that is > value and the rest of the operators from the first entry of the first leaf. Equal keys may
+ * continue to the leaves on the left of the one that descend() finds, so the scan moves back through
+ * prev_leaf while the last key of the previous leaf is still >= value. The leaf_block is -1 if the
+ * file holds no entries. The position is stored with the latch of the leaf held, so that an insert that
+ * comes after it moves the scan with the entries (see scanShift).
+ */
+static int scanStart(int fileIndex, int op, void *value, struct page_ref *page, int *leaf_block, int *position){
+    int attrLength1 = Files_array[fileIndex].attrLength1;
 
-                if(type == 'r'){
-                    /* Root was split */
-                    int root_block_number;
-                    if(BF_GetBlockCounter(file_id, &root_block_number) != BF_OK){
-                        AM_errno = AME_BLOCKS;
-                        return AM_errno;
-                    }
-                    if(BF_AllocateBlock(file_id, block) != BF_OK){
-                        AM_errno = AME_ALLOCATE;
-                        return AM_errno;
-                    }
-                    int entries = 1;
-                    data = BF_Block_GetData(block);
-                    memcpy(data, &type, sizeof(char));
-                    memcpy(data+sizeof(char), &entries, sizeof(int));
-                    memcpy(data+node_offset, &nodePointer, sizeof(int));
-                    memcpy(data+node_offset+sizeof(int), newchildentry, attrLength1);
-                    memcpy(data+node_offset+sizeof(int)+attrLength1, &new_node_id, sizeof(int));
-                    BF_Block_SetDirty(block);
-                    if(BF_UnpinBlock(block) != BF_OK){
-                        AM_errno = AME_UNPIN;
-                        return AM_errno;
-                    }
-                    Files_array[fileDesc].rootBlock = root_block_number;
+    int blocks_num;
+    if(blockCounter(fileIndex, &blocks_num) != AME_OK){
+        return AM_errno;
+    }
+    if(blocks_num == 1){
+        *position = 0;
+        __atomic_store_n(leaf_block, -1, __ATOMIC_RELEASE);
+        return AME_OK;
+    }
 
-                    if(BF_GetBlock(file_id, 0, block) != BF_OK){
-                        AM_errno = AME_UNPIN;
-                        return AM_errno;
-                    }
-                    data = BF_Block_GetData(block);
-                    memcpy(data+sizeof(char)*3+sizeof(int)*2, &root_block_number, sizeof(int));
-                    BF_Block_SetDirty(block);
-                    if(BF_UnpinBlock(block) != BF_OK){
-                        AM_errno = AME_UNPIN;
-                        return AM_errno;
-                    }
-                }
-                return 0;
-            } else {
-                /* The internal node has space for the newchildentry to be added */
-                int left_block;
-                int right_block;
-                void *value = malloc(attrLength1);
-                void *child_value = malloc(attrLength1);
-
-                memcpy(child_value, newchildentry, attrLength1);
-
-                int position;
-                for(int i = 0 ; i < entries ; i++){
-                    memcpy(&left_block, data+node_offset+node_entry_size*i, sizeof(int));
-                    memcpy(value, data+node_offset+sizeof(int)+node_entry_size*i, attrLength1);
-                    memcpy(&right_block, data+node_offset+node_entry_size*i+sizeof(int)+attrLength1, sizeof(int));
-
-                    if(attrType1 == 'i'){
-                        if(*(int*)value > *(int*)child_value){
-                            break;
-                        }
-
-                    } else if (attrType1 == 'f'){
-                        if(*(float*)value > *(float*)child_value){
-                            break;
-                        }
-
-                    } else if (attrType1 == 'c'){
-                        if(strcmp(value, child_value) > 0){
-                            break;
-                        }
-                    } else{
-                        AM_errno = AME_ERROR;
-                        return AM_errno;
-                    }
-                    position = i+1;
-                }
+    int keyed = (op == EQUAL || op == GREATER_THAN || op == GREATER_THAN_OR_EQUAL);
+    int strict = (op == GREATER_THAN);
+    char *data;
+    int leaf, start = 0;
 
-                void *this_entry = malloc(node_entry_size);
-                void *next_entry = malloc(node_entry_size);
-                memcpy(this_entry, data+node_offset+sizeof(int)+node_entry_size*position, node_entry_size);
-                memcpy(next_entry, data+node_offset+sizeof(int)+node_entry_size*(position+1), node_entry_size);
+    if(!keyed){
+        leaf = firstLeaf(fileIndex, page);
+    } else {
+        if(descend(fileIndex, value, Files_array[fileIndex].latch->rootBlock, page, NULL, -1, &leaf) != AME_OK){
+            return AM_errno;
+        }
+        data = page->data;
+        start = leafPosition(fileIndex, data, value, strict);
 
-                for(int j = position+1; j < entries; j++){
-                    memcpy(data+node_offset+sizeof(int)+node_entry_size*j, this_entry, node_entry_size);
-                    this_entry = next_entry;
-                    memcpy(next_entry, data+node_offset+sizeof(int)+node_entry_size*(j+1), node_entry_size);
-                }
+        /* The duplicates of a key are never in two posting leaves */
+        while(!strict && start == 0 && !Files_array[fileIndex].postings){
+            int prev_leaf, entries;
+            memcpy(&prev_leaf, data+sizeof(char)+sizeof(int)*2, sizeof(int));
+            /* The leaf stays held for the pagePut after the loop */
+            if(prev_leaf == -1){
+                break;
+            }
+            if(pagePut(fileIndex, page, 0) != AME_OK){
+                return AM_errno;
+            }
 
-                memcpy(data+node_offset+sizeof(int)+node_entry_size*position, newchildentry, node_entry_size);
-                BF_Block_SetDirty(block);
-                if(BF_UnpinBlock(block) != BF_OK){
-                    AM_errno = AME_UNPIN;
-                    return AM_errno;
-                }
-                free(newchildentry);
-                newchildentry = NULL;
-                return 0;
+            if(pageGet(fileIndex, prev_leaf, page) != AME_OK){
+                return AM_errno;
+            }
+            data = page->data;
+            memcpy(&entries, data+sizeof(char), sizeof(int));
+            statAdd(&Files_array[fileIndex].stats.comparisons, 1);
+            if(Files_array[fileIndex].keys->compare(data+leaf_offset+(entries-1)*attrLength1, value, attrLength1) < 0){
+                break;
             }
+            leaf = prev_leaf;
+            start = leafPosition(fileIndex, data, value, strict);
+        }
+        if(pagePut(fileIndex, page, 0) != AME_OK){
+            return AM_errno;
         }
     }
-    return 0;
+
+    /* Inserts may have moved the keys of the leaf since it was read, so the position is found again with its latch held */
+    pthread_rwlock_t *latch = leafLatch(fileIndex, leaf);
+    pthread_rwlock_rdlock(latch);
+    if(keyed){
+        if(pageGetHeld(fileIndex, leaf, page) != AME_OK){
+            pthread_rwlock_unlock(latch);
+            return AM_errno;
+        }
+        start = leafPosition(fileIndex, page->data, value, strict);
+        pagePut(fileIndex, page, 0);
+    }
+    *position = start;
+    __atomic_store_n(leaf_block, leaf, __ATOMIC_RELEASE);
+    pthread_rwlock_unlock(latch);
+    return AME_OK;
+}
+
+/**
+ * scanRelease(int scanDesc)
+ *  returns: nothing
+ *
+ * Frees the memory of the scan and empties its position of the Scans_array. It is called with table_lock held.
+ */
+static void scanRelease(int scanDesc){
+    /* So we can recognize which elements of the array are not being used */
+    free(Scans_array[scanDesc].value);
+    free(Scans_array[scanDesc].result);
+    pageDestroy(&Scans_array[scanDesc].leaf);
+    Scans_array[scanDesc].value = NULL;
+    Scans_array[scanDesc].result = NULL;
+    Scans_array[scanDesc].operator = 0;
+    Scans_array[scanDesc].block = -1;
+    Scans_array[scanDesc].position = -1;
+    Scans_array[scanDesc].fileDesc = -1;
 }
 
 /**
@@ -905,24 +4758,22 @@ int insertEntry(int fileDesc, int nodePointer, void *value1, void *value2, void
  * to all the scans that are opened at each moment.
  */
 int AM_OpenIndexScan(int fileDesc, int op, void *value) {
-    int fileIndex = -1;
-    for(int i = 0; i < MAX_OPEN_FILES; i++){
-        if(Files_array[i].fileDesc == fileDesc){
-            fileIndex = i;
-            break;
-        }
-    }
-    if(fileIndex == -1){
+    if(fileDesc < 0 || fileDesc >= MAX_OPEN_FILES || Files_array[fileDesc].fileDesc == -1){
         AM_errno = AME_NOTOPEN;
         return AM_errno;
     }
+    if(op < EQUAL || op > GREATER_THAN_OR_EQUAL){
+        AM_errno = AME_ERROR;
+        return AM_errno;
+    }
 
-    int rootBlock = Files_array[fileIndex].rootBlock;
+    int fileIndex = fileDesc;
     int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
-    char attrType1 = Files_array[fileIndex].attrType1, attrType2 = Files_array[fileIndex].attrType2;
+    statAdd(&Files_array[fileIndex].stats.lookups, 1);
 
     int flag = -1;
     int i;
+    pthread_mutex_lock(&table_lock);
     for( i = 0; i < MAX_OPEN_SCANS; i++){
         if(Scans_array[i].value == NULL){
             flag = 0;
@@ -930,158 +4781,346 @@ int AM_OpenIndexScan(int fileDesc, int op, void *value) {
         }
     }
     if(flag == -1){
+        pthread_mutex_unlock(&table_lock);
         AM_errno = AME_MAXSCANS;
         return AM_errno;
     }
+
+    /* The position is taken before the tree is read, so that a delete that comes later sees the scan */
     Scans_array[i].value = malloc(attrLength1);
     memcpy(Scans_array[i].value, value, attrLength1);
-    Scans_array[i].operator = op;
     Scans_array[i].fileDesc = fileDesc;
+    pthread_mutex_unlock(&table_lock);
+    Scans_array[i].result = malloc(attrLength2);
+    pageInit(&Scans_array[i].leaf, Files_array[fileIndex].page_size, 1);
+    Scans_array[i].operator = op;
+    Scans_array[i].item = 0;
+    Scans_array[i].overflow = -1;
+    Scans_array[i].prefetched = -1;
 
     /* Find the block and the position of the entry that satisfies the condition of the operator
      * For that purpose find the block that could hold the value. It will be the starting block.
+     * The operators that accept the lower keys start from the first leaf instead.
      */
+    latchShared(fileIndex);
+    int result = scanStart(fileIndex, op, value, &Scans_array[i].leaf, &Scans_array[i].block, &Scans_array[i].position);
+    latchRelease(fileIndex);
+    /* The nodes on the way down were read like those of any search, but the leaves after the first one are read once */
+    Scans_array[i].leaf.sequential = 1;
+    if(result != AME_OK){
+        pthread_mutex_lock(&table_lock);
+        scanRelease(i);
+        pthread_mutex_unlock(&table_lock);
+        return result;
+    }
 
-    int leaf_block = search(fileIndex, value, rootBlock);
-    Scans_array[i].block = leaf_block;
-    Scans_array[i].position = -1;
-
-    return AME_OK;
+    return i;
 }
 
 /**
- * Given a search key value, finds its leaf node.
+ * search(int fileIndex, void *value, int nodePointer)
+ *  returns: the block number of the leaf node that could hold value, Some error code - if it fails.
+ *
+ * Given a search key value, finds its leaf node, starting from the node nodePointer.
  */
 int search(int fileIndex, void *value, int nodePointer){
-    int fileDesc = Files_array[fileIndex].fileDesc;
-    char attrType1 = Files_array[fileIndex].attrType1;
-    int attrLength1 = Files_array[fileIndex].attrLength1;
-    char attrType2 = Files_array[fileIndex].attrType2;
-    int attrLength2 = Files_array[fileIndex].attrLength2;
+    struct page_ref page;
+    int leaf;
 
-    int node_entry_size = attrLength1+sizeof(int);
+    pageInit(&page, Files_array[fileIndex].page_size, 1);
+    latchShared(fileIndex);
+    if(descend(fileIndex, value, nodePointer, &page, NULL, -1, &leaf) != AME_OK || pagePut(fileIndex, &page, 0) != AME_OK){
+        leaf = AM_errno;
+    }
+    latchRelease(fileIndex);
+    pageDestroy(&page);
+    return leaf;
+}
 
-    BF_Block *block;
-    BF_Block_Init(&block);
-    char *data;
-    
-    if(BF_GetBlock(fileDesc, nodePointer, block) != BF_OK){
-        AM_errno = AME_GETBLOCK;
-        return AM_errno;
+/**
+ * scanMatch(int op, int result, int *stop)
+ *  returns: 1 - if a key that compares to the value of the scan as result satisfies op, 0 - if it does not.
+ *
+ * Sets stop to 1 if no key after this one can satisfy op, since the keys are read in ascending order.
+ */
+static int scanMatch(int op, int result, int *stop){
+    int match = 0;
+    *stop = 0;
+    switch(op){
+        case EQUAL:
+            match = (result == 0);
+            *stop = (result > 0);
+            break;
+        case NOT_EQUAL:
+            match = (result != 0);
+            break;
+        case LESS_THAN:
+            match = (result < 0);
+            *stop = !match;
+            break;
+        case GREATER_THAN:
+            match = (result > 0);
+            break;
+        case LESS_THAN_OR_EQUAL:
+            match = (result <= 0);
+            *stop = !match;
+            break;
+        case GREATER_THAN_OR_EQUAL:
+            match = (result >= 0);
+            break;
     }
-    data = BF_Block_GetData(block);
+    return match;
+}
 
-    char node_type;
-    int entries;
+/**
+ * scanMove(struct scan_info *scan, int block)
+ *  returns: nothing
+ *
+ * Moves the scan to the first entry of the leaf block, or ends it if block is -1. The position is set first,
+ * so an insert that finds the scan in its leaf, through scanShift, finds it at the right position.
+ */
+static void scanMove(struct scan_info *scan, int block){
+    scan->position = 0;
+    __atomic_store_n(&scan->block, block, __ATOMIC_RELEASE);
+}
 
-    memcpy(&node_type, data, sizeof(char));
-    memcpy(&entries, data+sizeof(char), sizeof(int));
+/* The leaves that a scan asks the system for before it reads them, when they are one after the other in the file */
+#define PREFETCH_LEAVES 8
+
+/**
+ * scanPrefetch(struct scan_info *scan, int leaf, int next_leaf)
+ *  returns: nothing
+ *
+ * Asks the system to start reading the pages after next_leaf, the leaf that the scan moves to from leaf, so
+ * that they are in memory when the BF level reads them and the scan does not wait for the disk at each leaf.
+ * The BF level has no call for it, so it is asked with posix_fadvise on a file of the latch that is only read.
+ * Only the leaves that follow each other in the file, as AM_BulkLoad and AM_Compact write them, are asked for:
+ * next_leaf is right after leaf, so the PREFETCH_LEAVES pages after it are probably the next leaves too. The
+ * next_leaf of leaves that lie elsewhere is known only when they are read, too late to read them early. A new
+ * group of pages is asked for when the scan reaches the middle of the last one.
+ */
+static void scanPrefetch(struct scan_info *scan, int leaf, int next_leaf){
+    int fileIndex = scan->fileDesc;
+    int page_blocks = Files_array[fileIndex].page_blocks;
+    int fd = Files_array[fileIndex].latch->prefetch_fd;
+    if(fd == -1 || Files_array[fileIndex].map != NULL || next_leaf != leaf+page_blocks){
+        return;
+    }
+    if(next_leaf+PREFETCH_LEAVES/2*page_blocks <= scan->prefetched){
+        return;
+    }
 
-    int left_value, right_value;
-    void *first_key_value = malloc(attrLength1);
-    void *last_key_value = malloc(attrLength1);
+    int from = (scan->prefetched > next_leaf) ? scan->prefetched : next_leaf;
+    int to = next_leaf+PREFETCH_LEAVES*page_blocks;
+    posix_fadvise(fd, (off_t)from*BF_BLOCK_SIZE, (off_t)(to-from)*BF_BLOCK_SIZE, POSIX_FADV_WILLNEED);
+    statAdd(&Files_array[fileIndex].stats.prefetched_pages, (to-from)/page_blocks);
+    scan->prefetched = to;
+}
 
+/**
+ * postingsStep(struct scan_info *scan, char *out, int maxRows, int *rows)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Reads the posting leaf of the scan, or the overflow page that it has reached, for scanNext. Every key is
+ * compared once and all of its values are copied together, from the slots of the leaf or from its overflow
+ * pages, which the scan reads in order before it goes on to the next key. The value of a key that the scan has
+ * reached is kept in item, so a batch may end in the middle of them.
+ */
+static int postingsStep(struct scan_info *scan, char *out, int maxRows, int *rows){
+    int fileIndex = scan->fileDesc;
+    const struct key_traits *key_traits = Files_array[fileIndex].keys;
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+    int stride = postingStride(fileIndex);
+    int max_entries = (Files_array[fileIndex].page_size-posting_offset)/stride;
+    char *data;
 
-    if(node_type == 'o' || node_type == 'l'){
-        if(BF_UnpinBlock(block) != BF_OK){
-            AM_errno = AME_UNPIN;
+    if(scan->overflow != -1){
+        /* The values of a hot key, one overflow page after the other. Only an insert that holds the latch of
+         * the index exclusively writes them, so they are copied without taking their own latch. */
+        if((Files_array[fileIndex].map != NULL ? pageGet(fileIndex, scan->overflow, &scan->leaf) :
+                                                  pageCopy(fileIndex, scan->overflow, &scan->leaf)) != AME_OK){
             return AM_errno;
         }
-        return nodePointer;
-    } else if(node_type == 'r' || node_type == 'n'){
-        if(attrType1 == 'i'){
-            memcpy(&left_value, data+node_offset, sizeof(int));
-            memcpy(first_key_value, data+node_offset+sizeof(int), attrLength1);
-            
-            if(*(int*)value < *(int*)first_key_value){
-                return search(fileIndex, value, left_value);
-            } else {
-                memcpy(&right_value, data+node_offset+node_entry_size*entries, sizeof(int));
-                memcpy(last_key_value, data+node_offset+sizeof(int)+node_entry_size*entries, attrLength1);
-
-                if(*(int*)value > *(int*)last_key_value){
-                    return search(fileIndex, value, right_value);
-                } else {
-                    int pointer;
-                    for(int i = 1; i < entries; i++){
-                        memcpy(&pointer, data+node_offset+node_entry_size*i, sizeof(int));
-                        memcpy(first_key_value, data+node_offset+sizeof(int)+node_entry_size*(i-1), attrLength1);
-                        memcpy(last_key_value, data+node_offset+sizeof(int)+node_entry_size*i, attrLength1);
-                        
-                        if((*(int*)value >= *(int*)first_key_value) &&(*(int*)value < *(int*)last_key_value)){
-                            return search(fileIndex, value, pointer);
-                        }
-                    }
-                    AM_errno = AME_ERROR;
-                    return AM_errno;
-                }
-            }
+        data = scan->leaf.data;
+        int count, next;
+        memcpy(&count, data+sizeof(char), sizeof(int));
+        memcpy(&next, data+sizeof(char)+sizeof(int), sizeof(int));
+        int n = (count-scan->item < maxRows-*rows) ? count-scan->item : maxRows-*rows;
+        memcpy(out+*rows*attrLength2, data+overflow_offset+scan->item*attrLength2, n*attrLength2);
+        *rows += n;
+        scan->item += n;
+        if(pagePut(fileIndex, &scan->leaf, 0) != AME_OK){
+            return AM_errno;
         }
-        if(attrType1 == 'f'){
-            memcpy(&left_value, data+node_offset, sizeof(int));
-            memcpy(first_key_value, data+node_offset+sizeof(int), attrLength1);
-            
-            if(*(float*)value < *(float*)first_key_value){
-                return search(fileIndex, value, left_value);
-            } else {
-                memcpy(&right_value, data+node_offset+node_entry_size*entries, sizeof(int));
-                memcpy(last_key_value, data+node_offset+sizeof(int)+node_entry_size*entries, attrLength1);
-
-                if(*(float*)value > *(float*)last_key_value){
-                    return search(fileIndex, value, right_value);
-                } else {
-                    int pointer;
-                    for(int i = 1; i < entries; i++){
-                        memcpy(&pointer, data+node_offset+node_entry_size*i, sizeof(int));
-                        memcpy(first_key_value, data+node_offset+sizeof(int)+node_entry_size*(i-1), attrLength1);
-                        memcpy(last_key_value, data+node_offset+sizeof(int)+node_entry_size*i, attrLength1);
-                        
-                        if((*(float*)value >= *(float*)first_key_value) &&(*(float*)value < *(float*)last_key_value)){
-                            return search(fileIndex, value, pointer);
-                        }
-                    }
-                    AM_errno = AME_ERROR;
-                    return AM_errno;
-                }
+        if(scan->item == count){
+            scan->overflow = next;
+            scan->item = 0;
+            if(next == -1){
+                scan->position++;
             }
         }
-        if(attrType1 == 'c'){
-            memcpy(&left_value, data+node_offset, sizeof(int));
-            memcpy(first_key_value, data+node_offset+sizeof(int), attrLength1);
-            
-            if(strcmp(value, first_key_value) < 0){
-                return search(fileIndex, value, left_value);
-            } else {
-                memcpy(&right_value, data+node_offset+node_entry_size*entries, sizeof(int));
-                memcpy(last_key_value, data+node_offset+sizeof(int)+node_entry_size*entries, attrLength1);
-
-                if(strcmp(value, last_key_value) > 0){
-                    return search(fileIndex, value, right_value);
-                } else {
-                    int pointer;
-                    for(int i = 1; i < entries; i++){
-                        memcpy(&pointer, data+node_offset+node_entry_size*i, sizeof(int));
-                        memcpy(first_key_value, data+node_offset+sizeof(int)+node_entry_size*(i-1), attrLength1);
-                        memcpy(last_key_value, data+node_offset+sizeof(int)+node_entry_size*i, attrLength1);
-                        
-                        if((strcmp(value, first_key_value) >= 0) && (strcmp(value, last_key_value) < 0)){
-                            return search(fileIndex, value, pointer);
-                        }
-                    }
-                    AM_errno = AME_ERROR;
-                    return AM_errno;
-                }
-            }
+        return AME_OK;
+    }
+
+    if(pageGetHeld(fileIndex, scan->block, &scan->leaf) != AME_OK){
+        return AM_errno;
+    }
+    data = scan->leaf.data;
+
+    char type;
+    int entries, next_leaf;
+    memcpy(&type, data, sizeof(char));
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+    memcpy(&next_leaf, data+sizeof(char)+sizeof(int), sizeof(int));
+    if((type != 'o' && type != 'l') || entries < 0 || entries > max_entries){
+        /* This is not a valid leaf node */
+        pagePut(fileIndex, &scan->leaf, 0);
+        scanMove(scan, -1);
+        AM_errno = AME_ERROR;
+        return AM_errno;
+    }
+
+    int stop = 0;
+    while(scan->position < entries && *rows < maxRows){
+        int result = key_traits->compare(data+posting_offset+stride*scan->position, scan->value, attrLength1);
+        int match = scanMatch(scan->operator, result, &stop);
+        statAdd(&Files_array[fileIndex].stats.comparisons, 1);
+        if(stop){
+            break;
         }
-        if(BF_UnpinBlock(block) != BF_OK){
-            AM_errno = AME_UNPIN;
-            return AM_errno;
+
+        if(match){
+            int start, end;
+            if(postingRun(fileIndex, data, scan->position, &start, &end)){
+                memcpy(&scan->overflow, overflowRecord(fileIndex, data, start), sizeof(int));
+                scan->item = 0;
+                break;
+            }
+            int n = (end-start-scan->item < maxRows-*rows) ? end-start-scan->item : maxRows-*rows;
+            for(int i = 0; i < n; i++){
+                memcpy(out+(*rows+i)*attrLength2, postingSlot(fileIndex, data, start+scan->item+i), attrLength2);
+            }
+            *rows += n;
+            scan->item += n;
+            if(scan->item < end-start){
+                break;
+            }
         }
-    } else {
+        scan->position++;
+        scan->item = 0;
+    }
+
+    if(pagePut(fileIndex, &scan->leaf, 0) != AME_OK){
+        return AM_errno;
+    }
+    if(stop){
+        scanMove(scan, -1);
+    } else if(scan->position == entries && scan->overflow == -1){
+        scanPrefetch(scan, scan->block, next_leaf);
+        scanMove(scan, next_leaf);
+    }
+    return AME_OK;
+}
+
+/**
+ * leafStep(struct scan_info *scan, char *out, int maxRows, int *rows)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Reads the leaf of the scan for scanNext, copying the second field of the entries that satisfy the condition
+ * of the scan to out, until the leaf ends, the bound of the operator is crossed or maxRows rows are in out.
+ */
+static int leafStep(struct scan_info *scan, char *out, int maxRows, int *rows){
+    int fileIndex = scan->fileDesc;
+    int max_entries = leafMaxEntries(fileIndex);
+    const struct key_traits *key_traits = Files_array[fileIndex].keys;
+    int attrLength1 = Files_array[fileIndex].attrLength1, attrLength2 = Files_array[fileIndex].attrLength2;
+
+    if(pageGetHeld(fileIndex, scan->block, &scan->leaf) != AME_OK){
+        return AM_errno;
+    }
+    char *data = scan->leaf.data;
+
+    char type;
+    int entries, next_leaf;
+    memcpy(&type, data, sizeof(char));
+    memcpy(&entries, data+sizeof(char), sizeof(int));
+    memcpy(&next_leaf, data+sizeof(char)+sizeof(int), sizeof(int));
+    if((type != 'o' && type != 'l') || entries < 0 || entries > max_entries){
+        /* This is not a valid leaf node */
+        pagePut(fileIndex, &scan->leaf, 0);
+        scanMove(scan, -1);
         AM_errno = AME_ERROR;
         return AM_errno;
     }
 
+    /* The keys and the values of the leaf are read one after the other */
+    char *keys = data+leaf_offset;
+    char *values = keys+max_entries*attrLength1;
+    int stop = 0;
+    int first = scan->position;
+    while(scan->position < entries && *rows < maxRows){
+        int result = key_traits->compare(keys+scan->position*attrLength1, scan->value, attrLength1);
+        int match = scanMatch(scan->operator, result, &stop);
+        if(stop){
+            break;
+        }
+
+        if(match){
+            memcpy(out+*rows*attrLength2, values+scan->position*attrLength2, attrLength2);
+            (*rows)++;
+        }
+        scan->position++;
+    }
+    statAdd(&Files_array[fileIndex].stats.comparisons, scan->position-first+stop);
+
+    if(pagePut(fileIndex, &scan->leaf, 0) != AME_OK){
+        return AM_errno;
+    }
+    if(stop){
+        scanMove(scan, -1);
+    } else if(scan->position == entries){
+        scanPrefetch(scan, scan->block, next_leaf);
+        scanMove(scan, next_leaf);
+    }
+    return AME_OK;
+}
+
+/**
+ * scanNext(struct scan_info *scan, char *out, int maxRows, int *nRows)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Copies the second field of the next (at most maxRows) entries of the scan that satisfy its
+ * condition to out, one after the other, and stores their number in nRows. Fewer than maxRows
+ * rows are returned only when the scan has ended.
+ *
+ * The scan walks the leaves from left to right through next_leaf, keeping only the current
+ * leaf pinned while it reads it, and every leaf is pinned once for all the rows that are taken
+ * from it. As soon as a key crosses the bound of the operator the scan ends, without reading
+ * the rest of the leaves. The latch of the leaf is held shared while the scan reads it and moves
+ * its position, so an insert to the leaf comes either before or after and finds the scan where
+ * the entries it read end.
+ */
+static int scanNext(struct scan_info *scan, char *out, int maxRows, int *nRows){
+    int fileIndex = scan->fileDesc;
+    int postings = Files_array[fileIndex].postings;
+    int attrLength2 = Files_array[fileIndex].attrLength2;
+
+    int rows = 0;
+    *nRows = 0;
+    while(scan->block != -1 && rows < maxRows){
+        pthread_rwlock_t *latch = leafLatch(fileIndex, scan->block);
+        pthread_rwlock_rdlock(latch);
+        int result = postings ? postingsStep(scan, out, maxRows, &rows) : leafStep(scan, out, maxRows, &rows);
+        pthread_rwlock_unlock(latch);
+        if(result != AME_OK){
+            return result;
+        }
+    }
+
+    statAdd(&Files_array[fileIndex].stats.scan_rows, rows);
+    statAdd(&Files_array[fileIndex].stats.bytes_copied, (long)rows*attrLength2);
+    *nRows = rows;
+    return AME_OK;
 }
 
 /**
@@ -1092,9 +5131,61 @@ int search(int fileIndex, void *value, int nodePointer){
  * satisfies the condition that is defined by the scan that corrensponds to
  * scanDesc. If there are no more records if returns NULL and sets the global
  * variable AM_errno to AME_EOF.
+ *
+ * The value that is returned stays valid until the next call for the same scan.
  */
 void *AM_FindNextEntry(int scanDesc) {
-	
+    if(scanDesc < 0 || scanDesc >= MAX_OPEN_SCANS || Scans_array[scanDesc].value == NULL){
+        AM_errno = AME_INVALID_SCAN;
+        return NULL;
+    }
+
+    int rows;
+    latchShared(Scans_array[scanDesc].fileDesc);
+    int result = scanNext(&Scans_array[scanDesc], Scans_array[scanDesc].result, 1, &rows);
+    latchRelease(Scans_array[scanDesc].fileDesc);
+    if(result != AME_OK){
+        return NULL;
+    }
+    if(rows == 0){
+        AM_errno = AME_EOF;
+        return NULL;
+    }
+    return Scans_array[scanDesc].result;
+}
+
+/**
+ * AM_FindNextBatch(int scanDesc, void *out, int maxRows, int *nRows)
+ *  returns: AME_OK - if it succeeds, AME_EOF - if there are no more records, Some other error code - if it fails.
+ *
+ * This function works like AM_FindNextEntry, but it copies the second field of up to maxRows
+ * entries to out (attrLength2 bytes each, one after the other) and stores their number in nRows.
+ * It needs a single call, and a single pin of every leaf, for a whole batch of rows, so it is the
+ * cheapest way to read a big range. A batch with fewer than maxRows rows means that the scan has
+ * ended, so the next call returns AME_EOF.
+ */
+int AM_FindNextBatch(int scanDesc, void *out, int maxRows, int *nRows) {
+    *nRows = 0;
+    if(scanDesc < 0 || scanDesc >= MAX_OPEN_SCANS || Scans_array[scanDesc].value == NULL){
+        AM_errno = AME_INVALID_SCAN;
+        return AM_errno;
+    }
+    if(maxRows < 1){
+        AM_errno = AME_ERROR;
+        return AM_errno;
+    }
+
+    latchShared(Scans_array[scanDesc].fileDesc);
+    int result = scanNext(&Scans_array[scanDesc], out, maxRows, nRows);
+    latchRelease(Scans_array[scanDesc].fileDesc);
+    if(result != AME_OK){
+        return result;
+    }
+    if(*nRows == 0){
+        AM_errno = AME_EOF;
+        return AM_errno;
+    }
+    return AME_OK;
 }
 
 /**
@@ -1105,9 +5196,201 @@ void *AM_FindNextEntry(int scanDesc) {
  * from the table of open scans.
  */
 int AM_CloseIndexScan(int scanDesc) {
+    pthread_mutex_lock(&table_lock);
+    if(scanDesc < 0 || scanDesc >= MAX_OPEN_SCANS || Scans_array[scanDesc].value == NULL){
+        pthread_mutex_unlock(&table_lock);
+        AM_errno = AME_INVALID_SCAN;
+        return AM_errno;
+    }
+
+    scanRelease(scanDesc);
+    pthread_mutex_unlock(&table_lock);
+    return AME_OK;
+}
+
+/**
+ * treeShape(int fileIndex, AM_Stats *stats)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Fills the height, the leaves, the entries, the free_pages, the leaf_jumps and the leaf_fill of stats, going
+ * down the first pointers from the root, along the leaves through next_leaf and then along the list of free
+ * pages. The entries of a posting leaf are its values, the ones in overflow pages included, and its fill is
+ * the part of the page that is used. The pages it reads are not counted.
+ */
+static int treeShape(int fileIndex, AM_Stats *stats){
+    int file_id = Files_array[fileIndex].fileDesc;
+    long blocks_pinned = Files_array[fileIndex].stats.blocks_pinned;
+    long bytes_copied = Files_array[fileIndex].stats.bytes_copied;
+
+    stats->height = 0;
+    stats->leaves = 0;
+    stats->entries = 0;
+    stats->free_pages = 0;
+    stats->leaf_jumps = 0;
+    stats->leaf_fill = 0;
+
+    int blocks_num;
+    if(blockCounter(fileIndex, &blocks_num) != AME_OK){
+        return AM_errno;
+    }
+    if(blocks_num == 1){
+        /* The file holds no entries */
+        return AME_OK;
+    }
+
+    struct page_ref *page = &Files_array[fileIndex].page;
+    char type = 'r';
+    int node = Files_array[fileIndex].latch->rootBlock;
+    int result = AME_OK;
+
+    while(result == AME_OK && (type == 'r' || type == 'n')){
+        if(pageGet(fileIndex, node, page) != AME_OK){
+            result = AM_errno;
+            break;
+        }
+        memcpy(&type, page->data, sizeof(char));
+        if(type == 'r' || type == 'n'){
+            memcpy(&node, page->data+node_offset, sizeof(int));
+        }
+        stats->height++;
+        result = pagePut(fileIndex, page, 0);
+    }
+
+    int postings = Files_array[fileIndex].postings;
+    long used = 0;
+    while(result == AME_OK && node != -1){
+        int entries, leaf = node;
+        if(pageGet(fileIndex, node, page) != AME_OK){
+            result = AM_errno;
+            break;
+        }
+        memcpy(&entries, page->data+sizeof(char), sizeof(int));
+        memcpy(&node, page->data+sizeof(char)+sizeof(int), sizeof(int));
+        stats->leaves++;
+        if(node != -1 && node < leaf){
+            stats->leaf_jumps++;
+        }
+        if(!postings){
+            stats->entries += entries;
+        }
+        for(int i = 0; postings && result == AME_OK && i < entries; i++){
+            int start, end;
+            if(!postingRun(fileIndex, page->data, i, &start, &end)){
+                stats->entries += end-start;
+                continue;
+            }
+            struct page_ref *over = &Files_array[fileIndex].new_page;
+            int next;
+            memcpy(&next, overflowRecord(fileIndex, page->data, start), sizeof(int));
+            while(result == AME_OK && next != -1){
+                int values;
+                if(pageGet(fileIndex, next, over) != AME_OK){
+                    result = AM_errno;
+                    break;
+                }
+                memcpy(&values, over->data+sizeof(char), sizeof(int));
+                memcpy(&next, over->data+sizeof(char)+sizeof(int), sizeof(int));
+                stats->entries += values;
+                result = pagePut(fileIndex, over, 0);
+            }
+        }
+        if(postings){
+            used += Files_array[fileIndex].page_size-posting_offset-postingFree(fileIndex, page->data);
+        }
+        if(result == AME_OK){
+            result = pagePut(fileIndex, page, 0);
+        } else {
+            pagePut(fileIndex, page, 0);
+        }
+    }
+    /* The free pages are counted along their list, where only the first block of each one is read, from the map or the BF level */
+    int free_page = Files_array[fileIndex].latch->free_list;
+    while(result == AME_OK && free_page != 0 && Files_array[fileIndex].map != NULL){
+        memcpy(&free_page, Files_array[fileIndex].map+(size_t)free_page*BF_BLOCK_SIZE+sizeof(char), sizeof(int));
+        stats->free_pages++;
+    }
+    while(result == AME_OK && free_page != 0){
+        if(pinFailed(bfGetBlock(file_id, free_page, page->block), AME_GETBLOCK)){
+            result = AM_errno;
+            break;
+        }
+        memcpy(&free_page, BF_Block_GetData(page->block)+sizeof(char), sizeof(int));
+        stats->free_pages++;
+        if(bfUnpinBlock(page->block) != BF_OK){
+            AM_errno = AME_UNPIN;
+            result = AM_errno;
+        }
+    }
+    if(postings && stats->leaves > 0){
+        stats->leaf_fill = (double)used/((double)stats->leaves*(Files_array[fileIndex].page_size-posting_offset));
+    } else if(stats->leaves > 0){
+        stats->leaf_fill = (double)stats->entries/((double)stats->leaves*leafMaxEntries(fileIndex));
+    }
+
+    Files_array[fileIndex].stats.blocks_pinned = blocks_pinned;
+    Files_array[fileIndex].stats.bytes_copied = bytes_copied;
+    return result;
+}
+
+/**
+ * AM_GetStats(int fileDesc, AM_Stats *stats)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Copies the counters of the open index fileDesc to stats, together with the height of its tree, the
+ * number of its leaves and entries and how full its leaves are. The counters start from zero when the
+ * index is opened or AM_ResetStats is called. If fileDesc is -1, stats gets the sum of the counters of
+ * all the indexes, the closed ones included, and the fields that describe a tree are left zero.
+ */
+int AM_GetStats(int fileDesc, AM_Stats *stats){
+    if(fileDesc == -1){
+        pthread_mutex_lock(&table_lock);
+        memcpy(stats, &closed_stats, sizeof(AM_Stats));
+        for(int i = 0; i < MAX_OPEN_FILES; i++){
+            if(Files_array[i].fileDesc != -1){
+                AM_Stats counters;
+                readCounters(&counters, &Files_array[i].stats);
+                addStats(stats, &counters);
+            }
+        }
+        pthread_mutex_unlock(&table_lock);
+        return AME_OK;
+    }
+    if(fileDesc < 0 || fileDesc >= MAX_OPEN_FILES || Files_array[fileDesc].fileDesc == -1){
+        AM_errno = AME_NOTOPEN;
+        return AM_errno;
+    }
+
+    /* treeShape reads the tree through the page of the index */
+    latchExclusive(fileDesc);
+    memcpy(stats, &Files_array[fileDesc].stats, sizeof(AM_Stats));
+    int result = treeShape(fileDesc, stats);
+    latchRelease(fileDesc);
+    return result;
+}
 
-    //scan_info[scanDesc] = NULL; // So we can recognize which elements of the array are not being used
+/**
+ * AM_ResetStats(int fileDesc)
+ *  returns: AME_OK - if it succeeds, Some error code - if it fails.
+ *
+ * Sets the counters of the open index fileDesc back to zero. If fileDesc is -1, the counters
+ * of all the indexes are set to zero, the ones kept for the closed indexes included.
+ */
+int AM_ResetStats(int fileDesc){
+    if(fileDesc == -1){
+        pthread_mutex_lock(&table_lock);
+        memset(&closed_stats, 0, sizeof(AM_Stats));
+        for(int i = 0; i < MAX_OPEN_FILES; i++){
+            resetCounters(&Files_array[i].stats);
+        }
+        pthread_mutex_unlock(&table_lock);
+        return AME_OK;
+    }
+    if(fileDesc < 0 || fileDesc >= MAX_OPEN_FILES || Files_array[fileDesc].fileDesc == -1){
+        AM_errno = AME_NOTOPEN;
+        return AM_errno;
+    }
 
+    resetCounters(&Files_array[fileDesc].stats);
     return AME_OK;
 }
 
@@ -1184,6 +5467,36 @@ void AM_PrintError(char *errString) {
         case AME_NOTOPEN:
                 printf("The file is not opened.");
                 break;
+        case AME_NOT_EMPTY:
+                printf("The file already holds entries.\n");
+                break;
+        case AME_FILL_FACTOR:
+                printf("The fill factor must be in (0, 1].\n");
+                break;
+        case AME_INVALID_SCAN:
+                printf("There is no such opened scan in the Scans_array.\n");
+                break;
+        case AME_PAGE_SIZE:
+                printf("The page size must be a multiple of the block size, up to 16384 bytes.\n");
+                break;
+        case AME_NOT_FOUND:
+                printf("The entry does not exist in the file.\n");
+                break;
+        case AME_KEY_FORMAT:
+                printf("The file was created in an older format that does not support this operation.\n");
+                break;
+        case AME_COMPACT:
+                printf("The file could not be replaced by its compacted copy, or it is opened more than once.\n");
+                break;
+        case AME_READ_ONLY:
+                printf("The file is opened read-only.\n");
+                break;
+        case AME_FULL_MEMORY:
+                printf("Every block of the buffer pool is pinned.\n");
+                break;
+        case AME_CONFIG:
+                printf("The size of the buffer pool, the replacement algorithm or the shards of the block cache are not valid.\n");
+                break;
         default:
                 printf("No error was attributed.\n");
                 break;
@@ -1199,5 +5512,5 @@ void AM_PrintError(char *errString) {
  * This function is used to destroy all the structures that have been initialized.
  */
 void AM_Close() {
-  
+    shardsDestroy();
 }